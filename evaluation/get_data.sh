@@ -6,6 +6,8 @@ variants=("manyant")
 #variants=("depmask" "samplemask")
 #variants=("parant" "parant2" "parant3" "parant4")
 #variants=("parant4" "localant" "gpumax")
+#variants=("gpumax" "gpumax:subgroup" "localant" "localant:subgroup" "neighbor" "neighbor:subgroup" "parant4" "parant4:subgroup")
+#variants=("gpumax" "gpumax:overlap" "hybrid" "hybrid:overlap")
 #problems=("./problems/ESC11.sop" "./problems/ESC25.sop" "./problems/ESC47.sop" "./problems/prob.100.sop")
 #problems=("problems/rbg109a.sop" "problems/rbg174a.sop")
 #problems=("problems/rbg253a.sop" "problems/rbg323a.sop")
@@ -18,25 +20,17 @@ problems=(./problems/seq-250-350/*.sop)
 
 runs=3
 
-for n in $(seq $runs)
+# One process per variant runs it on every problem, see `./build/main --help` for bench
+for variant in "${variants[@]}"
 do
-	echo "Starting run #$n"
-	for problem in "${problems[@]}"
-	do
-		#name=$(basename $problem .sop)
-		for variant in "${variants[@]}"
-		do
-			name="$variant.step.shower"
-			#name="parantN-big-step"
-			echo "Starting $variant on $problem"
-			if ./build/main $problem -c $variant -r 500 -a -o "./evaluation/$name.profile.csv";
-			then
-				echo "Finished $variant on $problem"
-			else
-				echo "Variant $variant returned error code on problem $name ($problem)"
-				echo "Ignoring error"
-			fi
-		done
-	done
+	name="$variant.step.shower"
+	#name="parantN-big-step"
+	echo "Starting $variant"
+	if ./build/main bench "${problems[@]}" -c "$variant" -r 500 --repetitions $runs -a -o "./evaluation/$name.profile.csv";
+	then
+		echo "Finished $variant"
+	else
+		echo "Variant $variant returned error code on some problems ($name), see above"
+		echo "Ignoring error"
+	fi
 done
-
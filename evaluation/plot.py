@@ -80,6 +80,14 @@ class Profile:
         self.etc = self.optr - self.adva - self.eval - self.upda
 
 
+def section_time(line: dict[str, str], section: str) -> float:
+    """
+    Variants that fuse stages (e.g. persistent) write an empty cell for them.
+    Such a section counts as 0, so its time stays in "etc" and --sections draws no bar for it.
+    """
+    value = line.get(section) or ""
+    return float(value) if value.strip() else 0.0
+
 variants: dict[tuple[str, str],Profile] = {}
 
 for file in args.file:
@@ -95,9 +103,9 @@ for file in args.file:
                 prep=float(line["prep"]),
                 optr=float(line["optr"]),
                 opts=float(line["opts"]),
-                adva=float(line["adva"]),
-                eval=float(line["eval"]),
-                upda=float(line["upda"])
+                adva=section_time(line, "adva"),
+                eval=section_time(line, "eval"),
+                upda=section_time(line, "upda")
             )
 
             if key not in variants:
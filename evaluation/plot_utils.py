@@ -19,6 +19,9 @@ def load_data(paths: Path | str | list[Path] | list[str], *, measurement: Measur
 			for line in reader:
 				variant = line["variant"]
 				problem = line["problem"]
+				# Variants that fuse stages (e.g. persistent) leave their cells empty, they have no such measurement
+				if not line[measurement].strip():
+					continue
 				time = float(line[measurement])
 
 				allow_variant = variants is None or variant in variants
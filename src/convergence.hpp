@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <vector>
+
+#include "profiler.hpp"
+
+/*
+Best route length of every round with the time it was reached, relative to start().
+Only filled while enabled; variants add a point once the best ant of a round is known.
+*/
+struct ConvergenceLog {
+	struct Point {
+		// Last round covered by the point, counting from 1
+		unsigned int round;
+		Profiler::Duration elapsed;
+		int iteration_best;
+		int best_so_far;
+	};
+
+	// Gaps to the lower solution bound reported as time-to-target
+	static constexpr std::array<double, 4> target_gaps = { 0.10, 0.05, 0.01, 0.0 };
+
+	bool enabled = false;
+	Profiler::Timepoint origin;
+	std::vector<Point> points;
+
+	void start() {
+		origin = Profiler::Clock::now();
+		points.clear();
+	}
+
+	/*
+	Adds a round that just finished on the host
+	*/
+	void add(int iteration_best) {
+		add(iteration_best, points.empty() ? iteration_best : std::min(points.back().best_so_far, iteration_best), Profiler::Clock::now(), 1);
+	}
+
+	/*
+	@param reached : When the round finished, e.g. the end of its last kernel moved onto the host clock
+	@param rounds : Rounds covered, more than one if only the last of several rounds is known
+	*/
+	void add(int iteration_best, int best_so_far, Profiler::Timepoint reached, unsigned int rounds) {
+		if (!enabled) {
+			return;
+		}
+		unsigned int round = points.empty() ? rounds : points.back().round + rounds;
+		points.push_back({ round, reached - origin, iteration_best, best_so_far });
+	}
+
+	/*
+	Relative distance of `length` above `lower_bound`
+	*/
+	static double gap(int length, int lower_bound) {
+		return static_cast<double>(length - lower_bound) / lower_bound;
+	}
+
+	/*
+	Time until the best route was within `target_gap` of `lower_bound`, empty if never or without a bound
+	*/
+	std::optional<Profiler::Duration> time_to_target(int lower_bound, double target_gap) const {
+		if (lower_bound <= 0) {
+			return std::nullopt;
+		}
+		for (const Point& point : points) {
+			if (gap(point.best_so_far, lower_bound) <= target_gap) {
+				return point.elapsed;
+			}
+		}
+		return std::nullopt;
+	}
+};
@@ -1,8 +1,14 @@
+#include <array>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <sstream>
 
 #include "profiler.hpp"
 #include "colony_factory.hpp"
 #include "cli.hpp"
+#include "regression.hpp"
 
 #include "variants/sequential.hpp"
 #include "variants/manyant.hpp"
@@ -20,6 +26,13 @@
 #include "variants/neighbor.hpp"
 #include "variants/constant.hpp"
 #include "variants/gpumax.hpp"
+#include "variants/persistent.hpp"
+#include "variants/gumbel.hpp"
+#include "variants/gumbelcpu.hpp"
+#include "variants/tiled.hpp"
+#include "variants/packed.hpp"
+#include "variants/hybrid.hpp"
+#include "variants/multidevice.hpp"
 
 
 Profiler Profiler::default_profiler;
@@ -33,14 +46,110 @@ std::string print_now() {
 	return std::string(now_str);
 }
 
+std::filesystem::path default_kernel_cache() {
+	if (const char* cache_home = std::getenv("XDG_CACHE_HOME")) {
+		return std::filesystem::path(cache_home) / "ant-colony-gpu";
+	}
+	if (const char* home = std::getenv("HOME")) {
+		return std::filesystem::path(home) / ".cache" / "ant-colony-gpu";
+	}
+	return "off";
+}
+
+/*
+Variants that fuse stages (e.g. persistent) have no separate measurement for them, their column stays empty
+*/
+void output_average(std::ostream& out, const Profiler::Identifier& id) {
+	if (Profiler::contains(id)) {
+		out << Profiler::analyze(id).avg.value<double, std::milli>();
+	}
+}
+
+double instructions_per_cycle(const Profiler::Analysis& analysis) {
+	return static_cast<double>(analysis.counters[PerfCounters::Instructions]) / std::max<uint64_t>(1, analysis.counters[PerfCounters::Cycles]);
+}
+
+/*
+Misses per ant-step of the construction, every ant takes one step per node and round
+*/
+void output_misses_per_step(std::ostream& out, const Profiler::Analysis& analysis, double ant_steps, char sep) {
+	for (auto counter : { PerfCounters::LlcMisses, PerfCounters::BranchMisses, PerfCounters::DtlbMisses }) {
+		out << sep;
+		if (analysis.counted > 0) {
+			out << analysis.counters[counter] / (analysis.counted * ant_steps);
+		}
+	}
+}
+
+/*
+Achieved rate of a stage from its analytic cost and average measured time, e.g. GB/s from bytes.
+Empty if the variant has no separate measurement of the stage.
+*/
+std::optional<double> stage_rate(const Profiler::Identifier& id, double per_round) {
+	if (!Profiler::contains(id)) {
+		return std::nullopt;
+	}
+	double seconds = Profiler::analyze(id).avg.value<double>();
+	return seconds > 0.0 ? std::optional<double>(per_round / seconds) : std::nullopt;
+}
+
+const std::array<std::pair<const char*, StageCost RoundCost::*>, 3> roofline_stages = {{
+	{ "adva", &RoundCost::advance },
+	{ "eval", &RoundCost::evaluate },
+	{ "upda", &RoundCost::update },
+}};
+
+void output_roofline(std::ostream& out, const RoundCost& cost, double bandwidth) {
+	out << "Roofline (measured bandwidth " << bandwidth / 1e9 << " GB/s):\n";
+	for (const auto& [id, stage] : roofline_stages) {
+		const StageCost& stage_cost = cost.*stage;
+		out
+			<< "  " << id << ": "
+			<< stage_cost.bytes / 1e6 << " MB, " << stage_cost.flops / 1e6 << " MFLOP per round, "
+			<< stage_cost.intensity() << " FLOP/B";
+		auto bytes_per_second = stage_rate(id, stage_cost.bytes);
+		auto flops_per_second = stage_rate(id, stage_cost.flops);
+		if (bytes_per_second && flops_per_second) {
+			out
+				<< ", " << *bytes_per_second / 1e9 << " GB/s"
+				<< " (" << 100.0 * *bytes_per_second / bandwidth << "% of bandwidth)"
+				<< ", " << *flops_per_second / 1e9 << " GFLOP/s"
+				<< " (memory roof " << stage_cost.intensity() * bandwidth / 1e9 << " GFLOP/s)";
+		}
+		out << "\n";
+	}
+}
+
+void output_memory(std::ostream& out, const std::string& kind, const MemoryAccount& memory) {
+	if (memory.allocations.empty()) {
+		return;
+	}
+	out << "  " << kind << " buffers: " << MemoryAccount::mebibytes(memory.total) << " MiB";
+	if (memory.capacity > 0) {
+		out << " of " << MemoryAccount::mebibytes(memory.capacity) << " MiB";
+	}
+	out << "\n";
+	for (const auto& [name, bytes] : memory.allocations) {
+		out << "    " << name << ": " << MemoryAccount::mebibytes(bytes) << " MiB\n";
+	}
+}
+
 void output_profiler(
 std::filesystem::path path,
 bool append,
 std::string variant,
 std::string problem,
 unsigned int rounds,
+unsigned int rounds_per_launch,
 int score,
-int score_cap) {
+int score_cap,
+double ant_steps,
+const ConvergenceLog& convergence,
+const MemoryAccount& host_memory,
+const MemoryAccount& device_memory,
+size_t peak_resident,
+const RoundCost& cost,
+double bandwidth) {
 	bool existed = std::filesystem::exists(path);
 	std::fstream file(path, std::fstream::in | std::fstream::out | (append ? std::fstream::app : std::fstream::trunc));
 
@@ -58,7 +167,28 @@ int score_cap) {
 			<< "eval" << sep
 			<< "upda" << sep
 			<< "score" << sep
-			<< "score_cap" << "\n";
+			<< "score_cap" << sep
+			<< "rounds_per_launch" << sep
+			<< "opts_stddev" << sep
+			<< "opts_p50" << sep
+			<< "opts_p90" << sep
+			<< "opts_p99" << sep
+			<< "opts_p999" << sep
+			<< "adva_ipc" << sep
+			<< "adva_llc_misses_per_step" << sep
+			<< "adva_branch_misses_per_step" << sep
+			<< "adva_dtlb_misses_per_step" << sep
+			<< "peak_rss_mib" << sep
+			<< "host_mib" << sep
+			<< "device_mib" << sep
+			<< "bandwidth_gbs";
+		for (const auto& [id, stage] : roofline_stages) {
+			file << sep << id << "_gbs" << sep << id << "_gflops";
+		}
+		for (double gap : ConvergenceLog::target_gaps) {
+			file << sep << "time_to_gap_" << gap;
+		}
+		file << "\n";
 	}
 
 	file 
@@ -68,12 +198,547 @@ int score_cap) {
 		<< rounds << sep
 		<< Profiler::first("prep").value<double, std::milli>() << sep
 		<< Profiler::first("optr").value<double, std::milli>() << sep
-		<< Profiler::analyze("opts").avg.value<double, std::milli>() << sep
-		<< Profiler::analyze("adva").avg.value<double, std::milli>() << sep
-		<< Profiler::analyze("eval").avg.value<double, std::milli>() << sep
-		<< Profiler::analyze("upda").avg.value<double, std::milli>() << sep
+		<< Profiler::analyze("opts").avg.value<double, std::milli>() << sep;
+	output_average(file, "adva");
+	file << sep;
+	output_average(file, "eval");
+	file << sep;
+	output_average(file, "upda");
+	auto step_analysis = Profiler::analyze("opts");
+	file
+		<< sep
 		<< score << sep
-		<< score_cap << "\n";
+		<< score_cap << sep
+		<< rounds_per_launch << sep
+		<< step_analysis.stddev.value<double, std::milli>() << sep
+		<< step_analysis.p50.value<double, std::milli>() << sep
+		<< step_analysis.p90.value<double, std::milli>() << sep
+		<< step_analysis.p99.value<double, std::milli>() << sep
+		<< step_analysis.p999.value<double, std::milli>() << sep;
+	if (Profiler::contains("adva")) {
+		auto advance_analysis = Profiler::analyze("adva");
+		if (advance_analysis.counted > 0) {
+			file << instructions_per_cycle(advance_analysis);
+		}
+		output_misses_per_step(file, advance_analysis, ant_steps, sep);
+	}
+	else {
+		file << sep << sep << sep;
+	}
+	file << sep;
+	if (peak_resident > 0) {
+		file << MemoryAccount::mebibytes(peak_resident);
+	}
+	file
+		<< sep << MemoryAccount::mebibytes(host_memory.total)
+		<< sep << MemoryAccount::mebibytes(device_memory.total)
+		<< sep;
+	if (bandwidth > 0.0) {
+		file << bandwidth / 1e9;
+	}
+	for (const auto& [id, stage] : roofline_stages) {
+		for (double per_round : { (cost.*stage).bytes, (cost.*stage).flops }) {
+			file << sep;
+			auto rate = stage_rate(id, per_round);
+			if (bandwidth > 0.0 && rate) {
+				file << *rate / 1e9;
+			}
+		}
+	}
+	for (double gap : ConvergenceLog::target_gaps) {
+		file << sep;
+		if (auto reached = convergence.time_to_target(score_cap, gap)) {
+			file << Profiler::Measurement(*reached).value<double, std::milli>();
+		}
+	}
+	file << "\n";
+}
+
+/*
+One row per logged round, elapsed time in milliseconds since the start of the optimization
+*/
+void output_convergence(
+std::filesystem::path path,
+bool append,
+std::string variant,
+std::string problem,
+int lower_bound,
+const ConvergenceLog& convergence) {
+	bool existed = std::filesystem::exists(path);
+	std::fstream file(path, std::fstream::in | std::fstream::out | (append ? std::fstream::app : std::fstream::trunc));
+
+	const char sep = ';';
+	if (!existed || !append) {
+		file
+			<< "variant" << sep
+			<< "problem" << sep
+			<< "timestamp" << sep
+			<< "round" << sep
+			<< "elapsed" << sep
+			<< "iteration_best" << sep
+			<< "best" << sep
+			<< "gap" << "\n";
+	}
+
+	std::string timestamp = print_now();
+	for (const auto& point : convergence.points) {
+		file
+			<< variant << sep
+			<< problem << sep
+			<< timestamp << sep
+			<< point.round << sep
+			<< Profiler::Measurement(point.elapsed).value<double, std::milli>() << sep
+			<< point.iteration_best << sep
+			<< point.best_so_far << sep;
+		if (lower_bound > 0) {
+			file << ConvergenceLog::gap(point.best_so_far, lower_bound);
+		}
+		file << "\n";
+	}
+}
+
+/*
+One row per non-empty histogram bucket of every profiler section, bounds in milliseconds
+*/
+void output_histograms(
+std::filesystem::path path,
+bool append,
+std::string variant,
+std::string problem) {
+	bool existed = std::filesystem::exists(path);
+	std::fstream file(path, std::fstream::in | std::fstream::out | (append ? std::fstream::app : std::fstream::trunc));
+
+	const char sep = ';';
+	if (!existed || !append) {
+		file
+			<< "variant" << sep
+			<< "problem" << sep
+			<< "timestamp" << sep
+			<< "section" << sep
+			<< "lower" << sep
+			<< "upper" << sep
+			<< "count" << "\n";
+	}
+
+	std::string timestamp = print_now();
+	for (const auto& id : Profiler::measurement_keys()) {
+		for (const auto& bucket : Profiler::analyze(id).histogram.buckets()) {
+			file
+				<< variant << sep
+				<< problem << sep
+				<< timestamp << sep
+				<< id << sep
+				<< Profiler::Measurement(bucket.lower).value<double, std::milli>() << sep
+				<< Profiler::Measurement(bucket.upper).value<double, std::milli>() << sep
+				<< bucket.count << "\n";
+		}
+	}
+}
+
+std::string json_string(const std::string& value) {
+	std::string escaped = "\"";
+	for (char c : value) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+		}
+		escaped += c;
+	}
+	return escaped + "\"";
+}
+
+/*
+Trace Event Format, opens in chrome://tracing and ui.perfetto.dev.
+Host sections get a track per thread, device commands a track per queue.
+The time a command waited between being queued and starting shows as an async "queued" slice.
+*/
+void output_trace(std::filesystem::path path, std::string variant) {
+	const auto& spans = Profiler::trace();
+	const auto& device_spans = Profiler::device_trace();
+
+	Profiler::Timepoint origin = Profiler::Timepoint::max();
+	uint32_t threads = 0;
+	uint32_t queues = 0;
+	for (const auto& span : spans) {
+		origin = std::min(origin, span.start);
+		threads = std::max(threads, span.thread + 1);
+	}
+	for (const auto& span : device_spans) {
+		origin = std::min(origin, span.queued);
+		queues = std::max(queues, span.queue + 1);
+	}
+	auto micros = [origin](Profiler::Timepoint time) {
+		return std::chrono::duration<double, std::micro>(time - origin).count();
+	};
+	auto duration_micros = [](Profiler::Duration duration) {
+		return std::chrono::duration<double, std::micro>(duration).count();
+	};
+
+	std::ofstream file(path);
+	file << std::fixed << std::setprecision(3);
+	file
+		<< "{\"otherData\":{\"variant\":" << json_string(variant) << "},\n"
+		<< "\"traceEvents\":[\n"
+		<< "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"host\"}},\n"
+		<< "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"device\"}}";
+	for (uint32_t thread = 0; thread < threads; thread++) {
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << thread
+			<< ",\"args\":{\"name\":\"thread " << thread << "\"}}";
+	}
+	for (uint32_t queue = 0; queue < queues; queue++) {
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << queue
+			<< ",\"args\":{\"name\":\"queue " << queue << "\"}}";
+	}
+
+	for (const auto& span : spans) {
+		file
+			<< ",\n{\"name\":" << json_string(span.section.name()) << ",\"cat\":\"host\",\"ph\":\"X\",\"pid\":0"
+			<< ",\"tid\":" << span.thread
+			<< ",\"ts\":" << micros(span.start)
+			<< ",\"dur\":" << duration_micros(span.duration) << "}";
+	}
+
+	for (size_t i = 0; i < device_spans.size(); i++) {
+		const auto& span = device_spans[i];
+		file
+			<< ",\n{\"name\":" << json_string(span.name) << ",\"cat\":\"kernel\",\"ph\":\"X\",\"pid\":1"
+			<< ",\"tid\":" << span.queue
+			<< ",\"ts\":" << micros(span.start)
+			<< ",\"dur\":" << duration_micros(span.end - span.start)
+			<< ",\"args\":{\"queued\":" << micros(span.queued)
+			<< ",\"submit\":" << micros(span.submit)
+			<< ",\"start\":" << micros(span.start)
+			<< ",\"end\":" << micros(span.end) << "}}"
+			<< ",\n{\"name\":" << json_string("queued " + span.name) << ",\"cat\":\"queue\",\"ph\":\"b\",\"pid\":1"
+			<< ",\"tid\":" << span.queue << ",\"id\":" << i << ",\"ts\":" << micros(span.queued) << "}"
+			<< ",\n{\"name\":" << json_string("queued " + span.name) << ",\"cat\":\"queue\",\"ph\":\"e\",\"pid\":1"
+			<< ",\"tid\":" << span.queue << ",\"id\":" << i << ",\"ts\":" << micros(span.start) << "}";
+	}
+	file << "\n]}\n";
+}
+
+AntParams default_params(const std::string& seed) {
+	AntParams params;
+	params.alpha = 0.5;
+	params.beta = 0.5;
+	params.q = 100;
+	params.rho = 0.5;
+
+	params.initial_pheromone = 1;
+	params.min_pheromone = 0.01;
+	params.max_pheromone = 100;
+
+	params.zero_weight = 0.001;
+	params.random_seed = std::hash<std::string>{}(seed);
+
+	params.kernel_directory = cli.param("kernels");
+	params.kernel_cache_directory = cli.param("kernel-cache") == "off" ? "" : cli.param("kernel-cache");
+	return params;
+}
+
+/*
+Creates the colony `variant[:arguments]`, prints why and returns nullptr if that fails
+*/
+std::unique_ptr<AntOptimizer> make_colony(const std::string& colony, const Problem& problem, AntParams params) {
+	std::string colonyIdentifier = colony;
+	std::string colonyArguments;
+	size_t argumentSep = colonyIdentifier.find_first_of(':');
+	if (argumentSep != std::string::npos) {
+		colonyArguments = colonyIdentifier.substr(argumentSep + 1);
+		colonyIdentifier = colonyIdentifier.substr(0, argumentSep);
+	}
+
+	ColonyFactory* factory = ColonyFactory::get(colonyIdentifier);
+	if (factory == nullptr) {
+		std::cerr
+			<< "Unknown colony identifier: "
+			<< "\"" << colonyIdentifier << "\""
+			<< std::endl;
+		return nullptr;
+	}
+
+	try {
+		params.variant_args = VariantArgs(colonyArguments);
+		params.variant_args.validate(factory->identifier().second, AntOptimizer::common_params);
+		return factory->make(problem, params);
+	}
+	catch (const std::invalid_argument& e) {
+		std::cerr << e.what() << "\n"
+			<< "Accepted: " << factory->signature() << ", " << AntOptimizer::common_params << std::endl;
+		return nullptr;
+	}
+}
+
+std::vector<std::string> split_words(const std::string& list) {
+	std::istringstream stream(list);
+	std::vector<std::string> words;
+	for (std::string word; stream >> word;) {
+		words.push_back(word);
+	}
+	return words;
+}
+
+bool matches_wildcard(const std::string& name, const std::string& pattern) {
+	size_t n = 0, p = 0, star = std::string::npos, star_n = 0;
+	while (n < name.size()) {
+		if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+			n++;
+			p++;
+		}
+		else if (p < pattern.size() && pattern[p] == '*') {
+			star = p++;
+			star_n = n;
+		}
+		else if (star != std::string::npos) {
+			p = star + 1;
+			n = ++star_n;
+		}
+		else {
+			return false;
+		}
+	}
+	while (p < pattern.size() && pattern[p] == '*') {
+		p++;
+	}
+	return p == pattern.size();
+}
+
+/*
+Problem files matching `pattern`, wildcards (* and ?) only in the file name
+*/
+std::vector<std::filesystem::path> expand_problems(const std::string& pattern) {
+	std::filesystem::path path(pattern);
+	std::string file_pattern = path.filename().string();
+	if (file_pattern.find_first_of("*?") == std::string::npos) {
+		return { path };
+	}
+
+	std::filesystem::path directory = path.has_parent_path() ? path.parent_path() : ".";
+	std::vector<std::filesystem::path> matches;
+	if (std::filesystem::is_directory(directory)) {
+		for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+			if (entry.is_regular_file() && matches_wildcard(entry.path().filename().string(), file_pattern)) {
+				matches.push_back(entry.path());
+			}
+		}
+	}
+	std::sort(matches.begin(), matches.end());
+	return matches;
+}
+
+/*
+Compares the results of a bench to the stored baseline of the same colonies, problems and seeds.
+Slower rounds count as a regression if the median grew by more than --threshold
+and the Mann-Whitney test rejects equal round times at the 1% level.
+At equal rounds and seed, a longer best route is a quality regression.
+@return Number of regressions
+*/
+int compare_bench(const std::vector<BenchResult>& results, const std::vector<BenchResult>& baseline, double threshold) {
+	constexpr double significance = 0.01;
+	int regressions = 0;
+	for (const BenchResult& result : results) {
+		auto base = std::find_if(baseline.begin(), baseline.end(),
+			[&result](const BenchResult& b) { return b.same_run(result); });
+		std::string name = result.colony + " on " + result.problem + " (seed " + result.seed + ")";
+		if (base == baseline.end()) {
+			std::cout << "NEW        " << name << "\n";
+			continue;
+		}
+
+		double median = BenchResult::median(result.round_ms);
+		double base_median = BenchResult::median(base->round_ms);
+		double change = base_median > 0.0 ? median / base_median - 1.0 : 0.0;
+		double p = mannWhitneyGreater(result.round_ms, base->round_ms);
+		bool slower = change > threshold && p < significance;
+		bool worse = result.rounds == base->rounds && result.best_length > base->best_length;
+		regressions += slower + worse;
+
+		std::cout
+			<< (slower ? "REGRESSION " : "ok         ") << name << ": median round "
+			<< base_median << "ms -> " << median << "ms (" << std::showpos << change * 100 << std::noshowpos << "%, p=" << p << ")\n";
+		if (worse) {
+			std::cout << "QUALITY    " << name << ": best route " << base->best_length << " -> " << result.best_length << "\n";
+		}
+		else if (result.rounds != base->rounds) {
+			std::cout << "           " << name << ": baseline ran " << base->rounds << " rounds, quality not compared\n";
+		}
+	}
+	return regressions;
+}
+
+/*
+Runs every colony of --colony on every problem for every seed of --seed and --repetitions times in this process,
+writing one row per run to the --output CSV in the columns of a single run.
+Problems are parsed once. A throwaway colony runs --warmup rounds before the measured runs of each colony and problem,
+so program builds, the driver and caches are warm. Every measured run gets a fresh colony and a reset profiler.
+A run that fails (bad colony arguments, no device, a buffer that does not fit) is reported and counted, the others continue.
+--histograms and --convergence get the rows of every run, --trace only describes a single run and is rejected.
+--compare and --save-baseline need the time of every round and are rejected with --profile-streaming.
+peak_rss_mib is reset before every run where the system allows it (Linux) and left empty elsewhere.
+*/
+int run_bench(const std::vector<std::string>& problem_patterns) {
+	std::vector<std::string> colonies = split_words(cli.param("colony"));
+	std::vector<std::string> seeds = split_words(cli.param("seed"));
+	unsigned int rounds = std::stoul(cli.param("rounds"));
+	unsigned int repetitions = std::stoul(cli.param("repetitions"));
+	unsigned int warmup = std::stoul(cli.param("warmup"));
+	if (colonies.empty() || problem_patterns.empty() || cli.param("output").empty()) {
+		std::cerr << "bench needs problems, colonies (-c \"gpumax localant:subgroup\") and an output file (-o)" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<Problem> problems;
+	for (const std::string& pattern : problem_patterns) {
+		for (const auto& path : expand_problems(pattern)) {
+			problems.emplace_back(path);
+		}
+	}
+	if (problems.empty()) {
+		std::cerr << "No problem files match" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!cli.param("trace").empty()) {
+		std::cerr << "--trace records a single run, run the colony without bench to trace it" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (cli.flag("profile-streaming") && (!cli.param("compare").empty() || !cli.param("save-baseline").empty())) {
+		// Streaming keeps only the first round of a run, too few samples for the regression test
+		std::cerr << "--compare and --save-baseline need every round time, leave out --profile-streaming" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	Profiler::set_streaming(cli.flag("profile-streaming"));
+	if (cli.flag("counters")) {
+		std::string error;
+		if (!Profiler::set_counting(true, error)) {
+			std::cerr << "Hardware counters unavailable, continuing without them: " << error << std::endl;
+		}
+	}
+
+	std::vector<BenchResult> baseline;
+	if (!cli.param("compare").empty()) {
+		try {
+			baseline = BenchResult::load(cli.param("compare"));
+		}
+		catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	bool append = cli.flag("append");
+	int failures = 0;
+	std::vector<BenchResult> results;
+	for (const std::string& colony : colonies) {
+		for (const Problem& problem : problems) {
+			if (warmup > 0) {
+				std::unique_ptr<AntOptimizer> warm = make_colony(colony, problem, default_params(seeds.front()));
+				if (!warm) {
+					failures++;
+					continue;
+				}
+				try {
+					warm->prepare();
+					warm->optimize(warmup);
+				}
+				catch (const std::exception& e) {
+					std::cerr << colony << " on " << problem.name << " (warmup): " << e.what() << std::endl;
+					failures++;
+					continue;
+				}
+			}
+
+			for (const std::string& seed : seeds) {
+				BenchResult result { colony, problem.name, seed, rounds, std::numeric_limits<int>::max(), {} };
+				for (unsigned int repetition = 0; repetition < repetitions; repetition++) {
+					std::unique_ptr<AntOptimizer> optimizer = make_colony(colony, problem, default_params(seed));
+					if (!optimizer) {
+						failures++;
+						continue;
+					}
+					Profiler::reset();
+					optimizer->convergence.enabled = !cli.param("convergence").empty();
+					// Without a reset the peak would be the highest of all earlier runs, the cell stays empty then
+					const bool peak_per_run = MemoryAccount::reset_peak_resident();
+
+					double bandwidth = 0.0;
+					try {
+						Profiler::start("prep");
+						optimizer->prepare();
+						Profiler::stop("prep");
+
+						optimizer->convergence.start();
+						Profiler::start("optr");
+						optimizer->optimize(rounds);
+						Profiler::stop("optr");
+
+						// Probed after the run, so the probe does not disturb the measurements
+						if (cli.flag("roofline")) {
+							bandwidth = optimizer->measureBandwidth();
+						}
+					}
+					catch (const std::exception& e) {
+						std::cerr << colony << " on " << problem.name << " (seed " << seed << ", run " << repetition + 1 << "): " << e.what() << std::endl;
+						failures++;
+						continue;
+					}
+
+					output_profiler(
+						cli.param("output"),
+						append,
+						colony,
+						problem.name,
+						rounds,
+						optimizer->rounds_per_launch,
+						optimizer->best_route_length,
+						problem.solution_bounds.first,
+						static_cast<double>(optimizer->ant_count) * (problem.size() - 1),
+						optimizer->convergence,
+						optimizer->host_memory,
+						optimizer->device_memory,
+						peak_per_run ? MemoryAccount::peak_resident_bytes() : 0,
+						optimizer->roundCost(),
+						bandwidth);
+					if (!cli.param("histograms").empty()) {
+						output_histograms(cli.param("histograms"), append, colony, problem.name);
+					}
+					if (optimizer->convergence.enabled) {
+						output_convergence(
+							cli.param("convergence"),
+							append,
+							colony,
+							problem.name,
+							problem.solution_bounds.first,
+							optimizer->convergence);
+					}
+					append = true;
+
+					result.best_length = std::min(result.best_length, optimizer->best_route_length);
+					for (auto& round : Profiler::at("opts")) {
+						result.round_ms.push_back(round.value<double, std::milli>());
+					}
+
+					std::cout
+						<< colony << " on " << problem.name << " (seed " << seed << ", run " << repetition + 1 << "): "
+						<< static_cast<double>(rounds) / Profiler::first("optr").value<double>() << " RPS\n";
+				}
+				if (!result.round_ms.empty()) {
+					results.push_back(result);
+				}
+			}
+		}
+	}
+
+	if (!cli.param("save-baseline").empty()) {
+		BenchResult::save(cli.param("save-baseline"), results);
+	}
+
+	int regressions = 0;
+	if (!cli.param("compare").empty()) {
+		regressions = compare_bench(results, baseline, std::stod(cli.param("threshold")));
+		std::cout << regressions << " regression" << (regressions == 1 ? "" : "s") << " against " << cli.param("compare") << "\n";
+	}
+	std::cout.flush();
+	return failures == 0 && regressions == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 int main(int argc, char* argv[]) {
@@ -93,14 +758,34 @@ int main(int argc, char* argv[]) {
 	ColonyFactory::add<NeighborOptimizer>();
 	ColonyFactory::add<ConstAntOptimizer>();
 	ColonyFactory::add<GpuMaxOptimizer>();
+	ColonyFactory::add<PersistentOptimizer>();
+	ColonyFactory::add<GumbelOptimizer>();
+	ColonyFactory::add<GumbelCpuOptimizer>();
+	ColonyFactory::add<TiledOptimizer>();
+	ColonyFactory::add<PackedOptimizer>();
+	ColonyFactory::add<HybridOptimizer>();
+	ColonyFactory::add<MultiDeviceOptimizer>();
 
 	cli.addFlag("help", "Prints this help message", {"h"});
 	cli.addFlag("list", "List all optimization variants available", {"l"});
-	cli.addParameter("colony", "Selects the colony to run. Colony arguments are separated by a colon (:)", {"c"});
+	cli.addParameter("colony", "Selects the colony to run. Colony arguments follow a colon as key=value pairs separated by commas (e.g. gpumax:ants=4096). Every colony accepts ants=<count>", {"c"});
 	cli.addParameter("rounds", "How many rounds of optimization should be run", {"r"}, "500");
-	cli.addParameter("seed", "Controls the random-number-generator seed", {}, "thomas");
+	cli.addParameter("seed", "Controls the random-number-generator seed. For bench a space separated list", {}, "thomas");
+	cli.addParameter("repetitions", "bench: Runs per colony, problem and seed", {}, "1");
+	cli.addParameter("save-baseline", "bench: Store the round times and best routes of all runs in this file for --compare");
+	cli.addParameter("compare", "bench: Compare against a file written by --save-baseline, failing on slower rounds or longer routes");
+	cli.addParameter("threshold", "bench: Relative growth of the median round time tolerated by --compare", {}, "0.05");
+	cli.addParameter("warmup", "bench: Rounds a throwaway colony runs before the measured runs of each colony and problem", {}, "20");
 	cli.addParameter("output", "Specify an output file to write the profiler results to", {"o"});
 	cli.addFlag("append", "Append to the file specified by --output instead of overwriting it. Used only when --output is specified", {"a"});
+	cli.addParameter("histograms", "Write the latency histogram of every profiler section to this file. Follows --append");
+	cli.addParameter("trace", "Write a timeline of host sections and OpenCL commands to this file (Trace Event Format, e.g. for ui.perfetto.dev). Single runs only, bench rejects it");
+	cli.addParameter("convergence", "Write the best route length of every round with its time to this file. Follows --append");
+	cli.addFlag("roofline", "Measure the memory bandwidth after the run and report GB/s and GFLOP/s per stage against it");
+	cli.addFlag("counters", "Count CPU cycles, instructions, LLC, branch and dTLB misses per profiler section (Linux perf_event_open)");
+	cli.addFlag("profile-streaming", "Keep only a histogram per profiler section instead of every measurement. Percentiles become approximate. Not with --compare or --save-baseline");
+	cli.addParameter("kernels", "Load OpenCL kernels from this directory (e.g. ./src/variants) instead of the ones embedded at build time", {"k"});
+	cli.addParameter("kernel-cache", "Directory to cache compiled OpenCL programs in. \"off\" disables the cache", {}, default_kernel_cache().string());
 
 	cli.parse(argc, argv);
 
@@ -108,7 +793,8 @@ int main(int argc, char* argv[]) {
 		std::cout 
 			<< "Ant Colony Optimization -- OpenCL\n"
 			<< "Usage:\n"
-			<< "  main <problem.sop> [flags]\n\n"
+			<< "  main <problem.sop> [flags]\n"
+			<< "  main bench <problem.sop or glob>... -c \"<colony> <colony>...\" -o <file.csv> [flags]\n\n"
 			<< "Flags:"
 			<< cli.help()
 			<< std::endl;
@@ -122,6 +808,10 @@ int main(int argc, char* argv[]) {
 		return EXIT_SUCCESS;
 	}
 
+	if (!cli.entries().empty() && cli.entries().front() == "bench") {
+		return run_bench(std::vector<std::string>(std::next(cli.entries().begin()), cli.entries().end()));
+	}
+
 	if (cli.entries().size() != 1) {
 		std::cerr
 			<< (cli.entries().size() == 0 ? "Not enough" : "Too many")
@@ -137,44 +827,44 @@ int main(int argc, char* argv[]) {
 		colonyArguments = colonyIdentifier.substr(argumentSep + 1);
 		colonyIdentifier = colonyIdentifier.substr(0, argumentSep);
 	}
-	
-	ColonyFactory* factory = ColonyFactory::get(colonyIdentifier);
-	if (factory == nullptr) {
-		std::cerr
-			<< "Unknown colony identifier: "
-			<< "\"" << colonyIdentifier << "\""
-			<< std::endl;
-		return EXIT_FAILURE;
-	}
 
 	Problem problem(cli.entries().front());
+	unsigned int rounds = std::stoul(cli.param("rounds"));
 
-	AntParams params;
-	params.alpha = 0.5;
-	params.beta = 0.5;
-	params.q = 100;
-	params.rho = 0.5;
-
-	params.initial_pheromone = 1;
-	params.min_pheromone = 0.01;
-	params.max_pheromone = 100;
-
-	params.zero_weight = 0.001;
-	params.random_seed = std::hash<std::string>{}(cli.param("seed"));
-
-	params.variant_args = colonyArguments;
+	std::unique_ptr<AntOptimizer> optimizer = make_colony(cli.param("colony"), problem, default_params(cli.param("seed")));
+	if (!optimizer) {
+		return EXIT_FAILURE;
+	}
 
-	unsigned int rounds = std::stoul(cli.param("rounds"));
+	Profiler::set_streaming(cli.flag("profile-streaming"));
+	Profiler::set_tracing(!cli.param("trace").empty());
+	if (cli.flag("counters")) {
+		std::string error;
+		if (!Profiler::set_counting(true, error)) {
+			std::cerr << "Hardware counters unavailable, continuing without them: " << error << std::endl;
+		}
+	}
+	optimizer->convergence.enabled = !cli.param("convergence").empty();
+	const double ant_steps = static_cast<double>(optimizer->ant_count) * (problem.size() - 1);
 
-	std::unique_ptr<AntOptimizer> optimizer = factory->make(problem, params);
+	double bandwidth = 0.0;
+	try {
+		Profiler::start("prep");
+		optimizer->prepare();
+		Profiler::stop("prep");
 
-	Profiler::start("prep");
-	optimizer->prepare();
-	Profiler::stop("prep");
+		optimizer->convergence.start();
+		Profiler::start("optr");
+		optimizer->optimize(rounds);
+		Profiler::stop("optr");
 
-	Profiler::start("optr");
-	optimizer->optimize(rounds);
-	Profiler::stop("optr");
+		// Probed after the run, so the probe does not disturb the measurements
+		bandwidth = cli.flag("roofline") ? optimizer->measureBandwidth() : 0.0;
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
 
 	if (cli.param("output").empty()) {
 		auto basic_analysis = Profiler::analyze("opts");
@@ -184,10 +874,17 @@ int main(int argc, char* argv[]) {
 			<< "Result length: " << optimizer->best_route_length << " (" << problem.solution_bounds.first << ", " << problem.solution_bounds.second << ")\n"
 			<< "Prepare Time: " << Profiler::first("prep").value<double, std::milli>() << "ms\n"
 			<< "Execution Time: " << Profiler::first("optr").value<double, std::milli>() << "ms\n"
+			<< "Rounds per launch: " << optimizer->rounds_per_launch << "\n"
 			<< "Step Time:\n" 
 				<< "  min: " << basic_analysis.min.value<double, std::milli>() << "ms\n"
 				<< "  max: " << basic_analysis.max.value<double, std::milli>() << "ms\n"
-				<< "  avg: " << basic_analysis.avg.value<double, std::milli>() << "ms\n";
+				<< "  avg: " << basic_analysis.avg.value<double, std::milli>() << "ms\n"
+				<< "  stddev: " << basic_analysis.stddev.value<double, std::milli>() << "ms\n"
+				<< "  p50/p90/p99/p99.9: "
+					<< basic_analysis.p50.value<double, std::milli>() << "/"
+					<< basic_analysis.p90.value<double, std::milli>() << "/"
+					<< basic_analysis.p99.value<double, std::milli>() << "/"
+					<< basic_analysis.p999.value<double, std::milli>() << "ms\n";
 
 		for (const auto& id : Profiler::measurement_keys()) {
 			auto analysis = Profiler::analyze(id);
@@ -195,10 +892,48 @@ int main(int argc, char* argv[]) {
 				<< "Measurement '" << id << "':\n"
 				<< "  min: " << analysis.min.value<double, std::milli>() << "ms\n"
 				<< "  max: " << analysis.max.value<double, std::milli>() << "ms\n"
-				<< "  avg: " << analysis.avg.value<double, std::milli>() << "ms\n";
+				<< "  avg: " << analysis.avg.value<double, std::milli>() << "ms\n"
+				<< "  stddev: " << analysis.stddev.value<double, std::milli>() << "ms\n"
+				<< "  p99: " << analysis.p99.value<double, std::milli>() << "ms\n";
+			if (analysis.counted > 0) {
+				std::cout << "  IPC: " << instructions_per_cycle(analysis) << "\n";
+				for (size_t c = 0; c < PerfCounters::count; c++) {
+					std::cout << "  " << PerfCounters::names[c] << ": " << analysis.counters[c] / analysis.counted << " per measurement\n";
+				}
+				if (id == "adva") {
+					std::cout << "  llc/branch/dtlb misses per ant-step: ";
+					output_misses_per_step(std::cout, analysis, ant_steps, ' ');
+					std::cout << "\n";
+				}
+			}
+		}
+
+		if (optimizer->convergence.enabled) {
+			std::cout << "Time to gap:\n";
+			for (double gap : ConvergenceLog::target_gaps) {
+				auto reached = optimizer->convergence.time_to_target(problem.solution_bounds.first, gap);
+				std::cout << "  " << gap * 100 << "%: ";
+				if (reached) {
+					std::cout << Profiler::Measurement(*reached).value<double, std::milli>() << "ms\n";
+				}
+				else {
+					std::cout << "not reached\n";
+				}
+			}
 		}
 
+		if (bandwidth > 0.0) {
+			output_roofline(std::cout, optimizer->roundCost(), bandwidth);
+		}
+
+		std::cout << "Memory:\n"
+			<< "  peak host RSS: " << MemoryAccount::mebibytes(MemoryAccount::peak_resident_bytes()) << " MiB\n";
+		output_memory(std::cout, "host", optimizer->host_memory);
+		output_memory(std::cout, "device", optimizer->device_memory);
+
 		std::cout
+			<< "Profiler overhead: " << Profiler::Measurement(Profiler::overhead()).value<double, std::milli>() << "ms"
+			<< " (" << Profiler::events_recorded() << " events)\n"
 			<< "Score: " << static_cast<double>(rounds) / Profiler::first("optr").value<double>()  << " RPS\n"
 			<< std::endl;
 	}
@@ -209,8 +944,38 @@ int main(int argc, char* argv[]) {
 			colonyIdentifier + (colonyArguments.empty() ? "" : ":" + colonyArguments),
 			problem.name,
 			rounds,
+			optimizer->rounds_per_launch,
 			optimizer->best_route_length,
-			problem.solution_bounds.first);
+			problem.solution_bounds.first,
+			ant_steps,
+			optimizer->convergence,
+			optimizer->host_memory,
+			optimizer->device_memory,
+			MemoryAccount::peak_resident_bytes(),
+			optimizer->roundCost(),
+			bandwidth);
+	}
+
+	if (!cli.param("histograms").empty()) {
+		output_histograms(
+			cli.param("histograms"),
+			cli.flag("append"),
+			colonyIdentifier + (colonyArguments.empty() ? "" : ":" + colonyArguments),
+			problem.name);
+	}
+
+	if (optimizer->convergence.enabled) {
+		output_convergence(
+			cli.param("convergence"),
+			cli.flag("append"),
+			colonyIdentifier + (colonyArguments.empty() ? "" : ":" + colonyArguments),
+			problem.name,
+			problem.solution_bounds.first,
+			optimizer->convergence);
+	}
+
+	if (!cli.param("trace").empty()) {
+		output_trace(cli.param("trace"), colonyIdentifier + (colonyArguments.empty() ? "" : ":" + colonyArguments));
 	}
 	
 	return EXIT_SUCCESS;
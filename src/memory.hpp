@@ -0,0 +1,84 @@
+#pragma once
+
+#include <fstream>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+/*
+Bytes per named allocation, names in order of their first allocation.
+Allocations sharing a name (e.g. the replicas of several devices) are summed.
+*/
+struct MemoryAccount {
+	std::vector<std::pair<std::string, size_t>> allocations;
+	size_t total = 0;
+	// Bytes available, 0 if unknown
+	size_t capacity = 0;
+
+	void add(const std::string& name, size_t bytes) {
+		total += bytes;
+		for (auto& allocation : allocations) {
+			if (allocation.first == name) {
+				allocation.second += bytes;
+				return;
+			}
+		}
+		allocations.emplace_back(name, bytes);
+	}
+
+	/*
+	Peak resident set size of the process since start or the last reset_peak_resident, 0 where unknown
+	*/
+	static size_t peak_resident_bytes() {
+#ifdef __linux__
+		// VmHWM follows reset_peak_resident, ru_maxrss keeps the peak of the whole process
+		std::ifstream status("/proc/self/status");
+		std::string key;
+		size_t kilobytes;
+		while (status >> key) {
+			if (key == "VmHWM:" && status >> kilobytes) {
+				return kilobytes * 1024;
+			}
+			status.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+		}
+#endif
+#if defined(__linux__) || defined(__APPLE__)
+		rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0) {
+			return 0;
+		}
+#ifdef __APPLE__
+		return static_cast<size_t>(usage.ru_maxrss);
+#else
+		// Linux reports kilobytes
+		return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+		return 0;
+#endif
+	}
+
+	/*
+	Lowers the peak resident set size to the current one, so the next peak covers only what runs after.
+	Returns false where the peak cannot be reset (only Linux allows it), the peak then stays the one of the whole process
+	*/
+	static bool reset_peak_resident() {
+#ifdef __linux__
+		std::ofstream clear_refs("/proc/self/clear_refs");
+		clear_refs << "5";
+		clear_refs.flush();
+		return clear_refs.good();
+#else
+		return false;
+#endif
+	}
+
+	static double mebibytes(size_t bytes) {
+		return bytes / (1024.0 * 1024.0);
+	}
+};
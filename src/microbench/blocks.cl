@@ -0,0 +1,239 @@
+/*
+	Building blocks of the colony kernels, each launched alone on synthetic buffers by the microbench.
+	They follow the corresponding steps of gpupher.cl and depmask.cl with one ant per work-item,
+	gumbel_draw follows the selection step of gumbel.cl with one work-item per candidate.
+*/
+
+uint rng_minstd_rand0(uint* state) {
+	const uint a = 16807;
+	const uint m = 2147483647;
+	// Schrage's decomposition m = a * q + r keeps a * state % m within 32 bits
+	const uint q = 127773;
+	const uint r = 2836;
+
+	uint a_lo = a * (*state % q);
+	uint r_hi = r * (*state / q);
+	*state = a_lo >= r_hi ? a_lo - r_hi : a_lo + (m - r_hi);
+
+	return *state;
+}
+
+double rng_range(uint* state, double max) {
+	uint r = rng_minstd_rand0(state);
+	double dr = (double)r / 2147483647.0;
+	return dr * max;
+}
+
+// Counter-based generator of gumbel.cl
+uint hash_uint(uint x) {
+	uint state = x * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+double rng_unit(uint seed, uint step, uint worker) {
+	uint h = hash_uint(seed ^ hash_uint(step ^ hash_uint(worker)));
+	return ((double)h + 0.5) / 4294967296.0;
+}
+
+// BITMASK_BITS is passed by the host to match the layout of the uploaded dependency masks
+#ifndef BITMASK_BITS
+#if defined(__opencl_c_int64) && !defined(FORCE_32BITMASK)
+#define BITMASK_BITS 64
+#else
+#define BITMASK_BITS 32
+#endif
+#endif
+
+#if BITMASK_BITS == 64
+typedef ulong bitmask;
+#else
+typedef uint bitmask;
+#endif
+const uint BITMASK_SIZE = BITMASK_BITS;
+
+/*
+	One roulette draw per ant over the allowed candidates of a probability row:
+	sums the candidates, then subtracts them again from a random share of the sum.
+	Ant a draws from row a % problem_size, -1 if no candidate is allowed.
+*/
+void kernel roulette(
+global const double* probabilities,
+global const int* ant_allowed,
+global int* ant_next,
+int problem_size,
+global uint* rng_seeds) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	int ant_idx = get_global_id(0);
+
+	const double* row = probabilities + (ant_idx % problem_size) * problem_size;
+	const int* allowed = ant_allowed + ant_idx * problem_size;
+	uint* seed = rng_seeds + ant_idx;
+
+	double sample_sum = 0.0;
+	for (int next = 0; next < problem_size; next++) {
+		sample_sum += allowed[next] == 0 ? row[next] : 0.0;
+	}
+
+	double rng = rng_range(seed, sample_sum);
+	int next_node = -1;
+	for (int next = 0; next < problem_size; next++) {
+		if (allowed[next] != 0) {
+			continue;
+		}
+		rng -= row[next];
+		if (rng < 0) {
+			next_node = next;
+			break;
+		}
+	}
+	ant_next[ant_idx] = next_node;
+}
+
+/*
+	Marks the node in ant_next as visited and releases the nodes depending on it,
+	scanning its column of the weight matrix for dependencies (-1)
+*/
+void kernel release_counters(
+global const int* weights,
+global const int* ant_next,
+global int* ant_allowed,
+int problem_size) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	int ant_idx = get_global_id(0);
+
+	int* allowed = ant_allowed + ant_idx * problem_size;
+	int next_node = ant_next[ant_idx];
+	if (next_node < 0) {
+		return;
+	}
+
+	allowed[next_node] = -1;
+	for (int i = 0; i < problem_size; i++) {
+		if (weights[i * problem_size + next_node] == -1) {
+			allowed[i] -= 1;
+		}
+	}
+}
+
+/*
+	Like release_counters, but walks the set bits of the dependency mask of the node
+*/
+void kernel release_mask(
+global const bitmask* dependencies,
+global const int* ant_next,
+global int* ant_allowed,
+int problem_size) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	int ant_idx = get_global_id(0);
+#ifdef BITMASK_WORDS
+	const int bitmask_size = BITMASK_WORDS;
+#else
+	const int bitmask_size = problem_size / BITMASK_SIZE + (problem_size % BITMASK_SIZE != 0 ? 1 : 0);
+#endif
+
+	int* allowed = ant_allowed + ant_idx * problem_size;
+	int next_node = ant_next[ant_idx];
+	if (next_node < 0) {
+		return;
+	}
+
+	allowed[next_node] = -1;
+	const bitmask* dep_mask = dependencies + next_node * bitmask_size;
+	uint bitidx = 0;
+	bitmask mask = dep_mask[bitidx];
+	while (true) {
+		uint first_nonzero = ctz(mask);
+		if (first_nonzero == BITMASK_SIZE) {
+			bitidx++;
+			if (bitidx >= bitmask_size) { break; }
+			mask = dep_mask[bitidx];
+		}
+		else {
+			allowed[first_nonzero + BITMASK_SIZE * bitidx] -= 1;
+			mask &= ~((bitmask)1 << first_nonzero);
+		}
+	}
+}
+
+/*
+	Evaporates every edge and lays pheromone along the route of the best ant, one work-item per edge
+*/
+void kernel update_pheromone(
+global double* pheromone,
+double one_minus_roh,
+double min_pheromone,
+double max_pheromone,
+global const int* ant_routes,
+global const int* best_ant,
+double q,
+int problem_size
+) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	const int best_ant_idx = best_ant[0];
+	const double best_ant_pheromone = q / best_ant[1];
+	int edge = get_global_id(0);
+	int from = edge / problem_size;
+	int to = edge % problem_size;
+	const int* best_ant_route = ant_routes + best_ant_idx * problem_size;
+
+	// Evaporate
+	pheromone[edge] *= one_minus_roh;
+
+	// Lay along best_ant
+	for (int i = 0; i + 1 < problem_size; i++) {
+		if (best_ant_route[i] == from && best_ant_route[i + 1] == to) {
+			pheromone[edge] += best_ant_pheromone;
+		}
+	}
+
+	pheromone[edge] = clamp(pheromone[edge], min_pheromone, max_pheromone);
+}
+
+/*
+	Repeated single steps of gumbel.cl from one fixed row: work-group d draws once as step d of `seed`,
+	each work-item scores its candidate and a max-reduction picks the node, -1 if no candidate is allowed.
+	The local size is a power of two not below problem_size.
+*/
+void kernel gumbel_draw(
+global const double* row,
+global const int* allowed,
+global int* draw_next,
+local double* key,
+local int* choice,
+int problem_size,
+uint seed) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	int draw_idx = get_group_id(1);
+	int worker_idx = get_local_id(0);
+	int worker_size = get_local_size(0);
+
+	const bool is_candidate = worker_idx < problem_size;
+	double weight = is_candidate && allowed[worker_idx] == 0 ? row[worker_idx] : 0.0;
+	key[worker_idx] = weight > 0.0 ? log(weight) - log(-log(rng_unit(seed, draw_idx, worker_idx))) : -INFINITY;
+	choice[worker_idx] = weight > 0.0 ? worker_idx : -1;
+
+	// Max-Reduction
+	for (int stride = worker_size / 2; stride > 0; stride /= 2) {
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (worker_idx < stride && key[worker_idx + stride] > key[worker_idx]) {
+			key[worker_idx] = key[worker_idx + stride];
+			choice[worker_idx] = choice[worker_idx + stride];
+		}
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+	if (worker_idx == 0) {
+		draw_next[draw_idx] = choice[0];
+	}
+}
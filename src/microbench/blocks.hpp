@@ -0,0 +1,397 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+#include "../variants/clcolony.hpp"
+
+/*
+Keeps the compiler from dropping a result that is never read, without costing more than a register
+*/
+template<typename T>
+inline void keep(const T& value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/*
+Writes a sequential ordering problem of `size` nodes in the TSPLIB format Problem reads.
+Every node depends on node 0, the last node on all others and any other node on each earlier one with probability `density`,
+so every instance is solvable.
+*/
+inline void writeSyntheticProblem(const std::filesystem::path& path, size_t size, double density, uint32_t seed) {
+	std::minstd_rand0 rng(seed);
+	std::uniform_int_distribution<int> weight(1, 1000);
+	std::bernoulli_distribution depends(density);
+
+	std::ofstream file(path);
+	file
+		<< "NAME: synthetic" << size << ".sop\n"
+		<< "TYPE: SOP\n"
+		<< "COMMENT: Synthetic instance of the microbench\n"
+		<< "DIMENSION: " << size << "\n"
+		<< "EDGE_WEIGHT_TYPE: EXPLICIT\n"
+		<< "EDGE_WEIGHT_FORMAT: FULL_MATRIX\n"
+		<< "EDGE_WEIGHT_SECTION\n"
+		<< size << "\n";
+	for (size_t from = 0; from < size; from++) {
+		for (size_t to = 0; to < size; to++) {
+			bool dependency = from > 0 && from != to
+				&& (to == 0 || from == size - 1 || (to < from && depends(rng)));
+			file << (to == 0 ? "" : " ") << (from == to ? 0 : dependency ? -1 : weight(rng));
+		}
+		file << "\n";
+	}
+	file << "EOF\n";
+}
+
+/*
+Single steps of a round on synthetic state, on the host as in SequentialOptimizer and as OpenCL kernels launched alone.
+The host and device copies of the state are independent, each block only reads the state of its own side.
+Steps that change the state (releasing dependencies, pheromone) keep changing it on repeated runs,
+which leaves their work per run unchanged.
+*/
+class BlockColony: public CLColonyOptimizer {
+protected:
+	std::filesystem::path kernel_directory;
+
+	cl::Program program;
+	cl::KernelFunctor<
+		cl::Buffer, // probabilities
+		cl::Buffer, // ant_allowed
+		cl::Buffer, // ant_next
+		cl_int,     // problem_size
+		cl::Buffer  // rng_seeds
+	> rouletteCL;
+
+	cl::KernelFunctor<
+		cl::Buffer, // weights
+		cl::Buffer, // ant_next
+		cl::Buffer, // ant_allowed
+		cl_int      // problem_size
+	> releaseCountersCL;
+
+	cl::KernelFunctor<
+		cl::Buffer, // dependencies
+		cl::Buffer, // ant_next
+		cl::Buffer, // ant_allowed
+		cl_int      // problem_size
+	> releaseMaskCL;
+
+	cl::KernelFunctor<
+		cl::Buffer,        // row
+		cl::Buffer,        // allowed
+		cl::Buffer,        // draw_next
+		cl::LocalSpaceArg, // key
+		cl::LocalSpaceArg, // choice
+		cl_int,            // problem_size
+		cl_uint            // seed
+	> gumbelDrawCL;
+
+	cl::KernelFunctor<
+		cl::Buffer, // pheromone
+		cl_double, // one_minus_roh
+		cl_double, // min_pheromone
+		cl_double, // max_pheromone
+		cl::Buffer, // ant_routes
+		cl::Buffer, // best_ant
+		cl_double, // q
+		cl_int  // problem_size
+	> updatePheromoneCL;
+
+	cl::Buffer probabilities_d;
+	cl::Buffer weights_d;
+	cl::Buffer dependencies_d;
+	cl::Buffer pheromone_d;
+	cl::Buffer routes_d;
+	cl::Buffer routes_length_d;
+	cl::Buffer roulette_allowed_d;
+	cl::Buffer release_allowed_d;
+	cl::Buffer roulette_next_d;
+	cl::Buffer release_next_d;
+	cl::Buffer rng_seeds_d;
+
+	// Host state
+	Graph<double> probabilities;
+	Graph<double> pheromone;
+	std::vector<cl_uint> host_dependency_mask;
+	std::vector<int> roulette_allowed;
+	std::vector<int> release_allowed;
+	std::vector<int> roulette_next;
+	// Node each ant visits when releasing dependencies
+	std::vector<int> release_next;
+	std::vector<uint32_t> rng_seeds;
+	// Every ant walks the nodes in order, which satisfies all dependencies
+	std::vector<int> routes;
+	std::vector<int> routes_length;
+
+	static Profiler::Duration launchDuration(const cl::Event& launch) {
+		launch.wait();
+		return eventDuration(launch, launch);
+	}
+
+public:
+	static constexpr const char* static_name = "blocks";
+	static constexpr const char* static_params = "";
+
+	BlockColony(const Problem& problem, AntParams params, std::filesystem::path kernel_directory)
+	:	CLColonyOptimizer::CLColonyOptimizer(problem, params),
+		kernel_directory(kernel_directory),
+		rouletteCL(cl::Kernel()),
+		releaseCountersCL(cl::Kernel()),
+		releaseMaskCL(cl::Kernel()),
+		gumbelDrawCL(cl::Kernel()),
+		updatePheromoneCL(cl::Kernel()),
+		pheromone(problem.size(), params.initial_pheromone) {
+		prepareHost();
+	}
+
+	using CLColonyOptimizer::getVisibility;
+	using CLColonyOptimizer::getDependencyMask;
+
+	/*
+	Sets up OpenCL and copies the host state to the device, not needed for the host blocks
+	*/
+	void prepare() override {
+		setupCL(false);
+		program = loadProgram(kernel_directory / "blocks.cl", specializationArgs());
+
+		probabilities_d = createAndFillBuffer("probabilities", problem.sizeSqr(), true, probabilities);
+		weights_d = wrapHostBuffer("weights", problem.weights);
+		dependencies_d = createDependencyBuffer(false);
+		pheromone_d = createAndFillBuffer("pheromone", problem.sizeSqr(), false, pheromone);
+		routes_d = createAndFillBuffer("routes", routes.size(), true, routes);
+		routes_length_d = createAndFillBuffer("routes_length", routes_length.size(), true, routes_length);
+		roulette_allowed_d = createAndFillBuffer("roulette_allowed", roulette_allowed.size(), true, roulette_allowed);
+		release_allowed_d = createAndFillBuffer("release_allowed", release_allowed.size(), false, release_allowed);
+		roulette_next_d = createBuffer<int>("roulette_next", ant_count, false);
+		release_next_d = createAndFillBuffer("release_next", release_next.size(), true, release_next);
+		rng_seeds_d = createAndFillBuffer("rng_seeds", rng_seeds.size(), false, rng_seeds);
+
+		setupBestAnt();
+		queue.finish();
+
+		rouletteCL = decltype(rouletteCL)(cl::Kernel(program, "roulette"));
+		releaseCountersCL = decltype(releaseCountersCL)(cl::Kernel(program, "release_counters"));
+		releaseMaskCL = decltype(releaseMaskCL)(cl::Kernel(program, "release_mask"));
+		gumbelDrawCL = decltype(gumbelDrawCL)(cl::Kernel(program, "gumbel_draw"));
+		updatePheromoneCL = decltype(updatePheromoneCL)(cl::Kernel(program, "update_pheromone"));
+
+		// The pheromone update reads the best ant
+		launchBestAnt();
+	}
+
+	/*
+	Blocks are run one at a time through their own methods
+	*/
+	void optimize(unsigned int rounds) override {}
+
+	// Host blocks
+
+	void roulette() {
+		const size_t n = problem.size();
+		for (size_t ant = 0; ant < ant_count; ant++) {
+			const double* row = probabilities.adjacency_matrix.data.data() + (ant % n) * n;
+			const int* allowed = roulette_allowed.data() + ant * n;
+
+			double sum = 0.0;
+			for (size_t next = 0; next < n; next++) {
+				sum += allowed[next] == 0 ? row[next] : 0.0;
+			}
+
+			uint32_t& state = rng_seeds[ant];
+			state = (16807ULL * state) % 2147483647;
+			double rd = (static_cast<double>(state) / 2147483647.0) * sum;
+			int next_node = -1;
+			for (size_t next = 0; next < n; next++) {
+				if (allowed[next] != 0) { continue; }
+				rd -= row[next];
+				if (rd < 0) {
+					next_node = next;
+					break;
+				}
+			}
+			roulette_next[ant] = next_node;
+		}
+		keep(roulette_next.data());
+	}
+
+	void releaseCounters() {
+		const size_t n = problem.size();
+		for (size_t ant = 0; ant < ant_count; ant++) {
+			int* allowed = release_allowed.data() + ant * n;
+			int next_node = release_next[ant];
+			allowed[next_node] = -1;
+			for (size_t from = 0; from < n; from++) {
+				if (problem.dependencies.edge(from, next_node)) {
+					allowed[from] -= 1;
+				}
+			}
+		}
+		keep(release_allowed.data());
+	}
+
+	void releaseMask() {
+		const size_t n = problem.size();
+		const size_t words = n / 32 + (n % 32 != 0 ? 1 : 0);
+		for (size_t ant = 0; ant < ant_count; ant++) {
+			int* allowed = release_allowed.data() + ant * n;
+			int next_node = release_next[ant];
+			allowed[next_node] = -1;
+			const cl_uint* dep_mask = host_dependency_mask.data() + next_node * words;
+			for (size_t word = 0; word < words; word++) {
+				for (uint32_t mask = dep_mask[word]; mask != 0; mask &= mask - 1) {
+					allowed[__builtin_ctz(mask) + 32 * word] -= 1;
+				}
+			}
+		}
+		keep(release_allowed.data());
+	}
+
+	void updatePheromone() {
+		const size_t n = problem.size();
+		for (auto& value : pheromone.adjacency_matrix.data) {
+			value *= (1.0 - params.rho);
+		}
+
+		const size_t best_ant = bestAnt();
+		const int* best_route = routes.data() + best_ant * n;
+		double spread = params.q / routes_length[best_ant];
+		for (size_t i = 1; i < n; i++) {
+			pheromone.edge(best_route[i - 1], best_route[i]) += spread;
+		}
+
+		for (auto& value : pheromone.adjacency_matrix.data) {
+			value = std::clamp(value, params.min_pheromone, params.max_pheromone);
+		}
+		keep(pheromone.adjacency_matrix.data.data());
+	}
+
+	/*
+	@return Index of the shortest route, the lowest index among ties
+	*/
+	size_t bestAnt() const {
+		size_t best = 0;
+		for (size_t ant = 1; ant < ant_count; ant++) {
+			if (routes_length[ant] < routes_length[best]) {
+				best = ant;
+			}
+		}
+		return best;
+	}
+
+	// OpenCL blocks, each returning the time the device spent on it
+
+	Profiler::Duration launchRoulette() {
+		return launchDuration(rouletteCL(
+			cl::EnqueueArgs(queue, cl::NDRange(ant_count)),
+			probabilities_d,
+			roulette_allowed_d,
+			roulette_next_d,
+			problem.size(),
+			rng_seeds_d
+		));
+	}
+
+	Profiler::Duration launchReleaseCounters() {
+		return launchDuration(releaseCountersCL(
+			cl::EnqueueArgs(queue, cl::NDRange(ant_count)),
+			weights_d,
+			release_next_d,
+			release_allowed_d,
+			problem.size()
+		));
+	}
+
+	Profiler::Duration launchReleaseMask() {
+		return launchDuration(releaseMaskCL(
+			cl::EnqueueArgs(queue, cl::NDRange(ant_count)),
+			dependencies_d,
+			release_next_d,
+			release_allowed_d,
+			problem.size()
+		));
+	}
+
+	Profiler::Duration launchUpdatePheromone() {
+		return launchDuration(updatePheromoneCL(
+			cl::EnqueueArgs(queue, cl::NDRange(problem.sizeSqr())),
+			pheromone_d,
+			1 - params.rho,
+			params.min_pheromone,
+			params.max_pheromone,
+			routes_d,
+			best_ant_d,
+			params.q,
+			problem.size()
+		));
+	}
+
+	Profiler::Duration launchBestAnt() {
+		return launchDuration(getBestAnt(routes_length_d, {}).back());
+	}
+
+	/*
+	Draws `draws` next nodes on the device with the Gumbel-max step of gumbel.cl, not timed
+	@param row : Weight of every candidate, pheromone^alpha * visibility
+	@param allowed : Allowed counters, only candidates at 0 may be drawn
+	@return How often every node was drawn, the last entry counts failed draws
+	*/
+	std::vector<size_t> gumbelDraws(const std::vector<double>& row, const std::vector<int>& allowed, size_t draws, uint32_t seed) {
+		size_t work_size = 1;
+		while (work_size < problem.size()) {
+			work_size *= 2;
+		}
+
+		cl::Buffer row_d = createAndFillBuffer("draw_row", row.size(), true, row);
+		cl::Buffer allowed_d = createAndFillBuffer("draw_allowed", allowed.size(), true, allowed);
+		cl::Buffer next_d = createBuffer<int>("draw_next", draws, false);
+		gumbelDrawCL(
+			cl::EnqueueArgs(queue, cl::NDRange(work_size, draws), cl::NDRange(work_size, 1)),
+			row_d,
+			allowed_d,
+			next_d,
+			createLocalBuffer<double>(work_size),
+			createLocalBuffer<int>(work_size),
+			problem.size(),
+			seed
+		);
+
+		// Blocking, so the uploads of `row` and `allowed` finished as well
+		std::vector<int> next(draws);
+		queue.enqueueReadBuffer(next_d, CL_TRUE, 0, sizeof(int) * draws, next.data());
+		std::vector<size_t> counts(problem.size() + 1, 0);
+		for (int node : next) {
+			counts[node < 0 ? counts.size() - 1 : node]++;
+		}
+		return counts;
+	}
+
+protected:
+	void prepareHost() {
+		const size_t n = problem.size();
+		probabilities = getVisibility();
+		host_dependency_mask = getDependencyMask(false);
+
+		// The first step of every ant: only nodes without open dependencies are allowed
+		std::vector<int> allowed_template = getAllowedList();
+		for (size_t ant = 0; ant < ant_count; ant++) {
+			roulette_allowed.insert(roulette_allowed.end(), allowed_template.begin(), allowed_template.end());
+			release_next.push_back(1 + ant % (n - 1));
+			for (size_t node = 0; node < n; node++) {
+				routes.push_back(node);
+			}
+		}
+		release_allowed = roulette_allowed;
+		roulette_next.resize(ant_count, -1);
+
+		std::vector<uint> rngs = getRngs();
+		rng_seeds.assign(rngs.begin(), rngs.end());
+
+		std::minstd_rand0 rng(params.random_seed);
+		std::uniform_int_distribution<int> length(n, 1000 * n);
+		for (size_t ant = 0; ant < ant_count; ant++) {
+			routes_length.push_back(length(rng));
+		}
+	}
+};
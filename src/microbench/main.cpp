@@ -0,0 +1,342 @@
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "../profiler.hpp"
+#include "../cli.hpp"
+#include "blocks.hpp"
+#include "selection_check.hpp"
+
+Profiler Profiler::default_profiler;
+CliParameters cli;
+
+std::vector<size_t> parse_sizes(const std::string& list) {
+	std::vector<size_t> sizes;
+	std::istringstream words(list);
+	for (std::string word; words >> word;) {
+		sizes.push_back(std::stoul(word));
+	}
+	return sizes;
+}
+
+/*
+Pins the calling thread, which runs the host blocks and submits the kernels, to one core
+*/
+bool pin_to_core(int core, std::string& error) {
+#ifdef __linux__
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(core, &cpus);
+	if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+		error = std::string("sched_setaffinity: ") + std::strerror(errno);
+		return false;
+	}
+	return true;
+#else
+	error = "pinning needs Linux sched_setaffinity";
+	return false;
+#endif
+}
+
+/*
+Runs `block` --warmup times unmeasured, then --samples times into the profiler
+@param block : Callable returning the duration of one run
+*/
+template<typename Block>
+Profiler::Analysis measure(Block block) {
+	Profiler::reset();
+	for (unsigned int i = std::stoul(cli.param("warmup")); i > 0; i--) {
+		block();
+	}
+	for (unsigned int i = std::stoul(cli.param("samples")); i > 0; i--) {
+		Profiler::record("blck", block());
+	}
+	return Profiler::analyze("blck");
+}
+
+/*
+Times a host block with the profiler clock
+*/
+template<typename Block>
+Profiler::Analysis measure_host(Block block) {
+	return measure([&block]() {
+		Profiler::Timepoint start = Profiler::Clock::now();
+		block();
+		return Profiler::Clock::now() - start;
+	});
+}
+
+bool selected(const std::string& block) {
+	std::string blocks = " " + cli.param("blocks") + " ";
+	return cli.param("blocks").empty() || blocks.find(" " + block + " ") != std::string::npos;
+}
+
+/*
+Prints the statistics of one block and appends them to the open --output file
+@param ants : Ants per run, 0 for blocks that only depend on the problem size
+*/
+void report(std::ofstream& csv, const std::string& block, const std::string& implementation, size_t size, size_t ants, const Profiler::Analysis& analysis) {
+	auto us = [](Profiler::Measurement m) { return m.value<double, std::micro>(); };
+	std::cout
+		<< std::left << std::setw(14) << block
+		<< std::setw(8) << implementation
+		<< "n=" << std::setw(6) << size
+		<< "ants=" << std::setw(7) << (ants == 0 ? "-" : std::to_string(ants))
+		<< std::right << std::fixed << std::setprecision(2)
+		<< " p50 " << std::setw(10) << us(analysis.p50) << "us"
+		<< "  p90 " << std::setw(10) << us(analysis.p90) << "us"
+		<< "  p99 " << std::setw(10) << us(analysis.p99) << "us"
+		<< "  min " << std::setw(10) << us(analysis.min) << "us"
+		<< "  avg " << us(analysis.avg) << " +- " << us(analysis.stddev) << "us"
+		<< std::defaultfloat << "\n";
+
+	if (!csv.is_open()) {
+		return;
+	}
+	const char sep = ';';
+	csv
+		<< block << sep
+		<< implementation << sep
+		<< size << sep
+		<< (ants == 0 ? "" : std::to_string(ants)) << sep
+		<< analysis.count << sep
+		<< us(analysis.min) << sep
+		<< us(analysis.avg) << sep
+		<< us(analysis.stddev) << sep
+		<< us(analysis.p50) << sep
+		<< us(analysis.p90) << sep
+		<< us(analysis.p99) << sep
+		<< us(analysis.max) << "\n";
+}
+
+/*
+Draws --draws next nodes from a fixed pheromone row through the roulette of "sequential", the Gumbel-max of "gumbelcpu"
+and, with `device`, the Gumbel-max step of gumbel.cl, with some candidates masked.
+Tests every implementation against the roulette distribution pheromone^alpha * visibility by Pearson's chi-square
+@return Whether all fit at the 0.001 level
+*/
+bool selection_check(const AntParams& params, bool device) {
+	const size_t size = 10;
+	const size_t draws = std::stoul(cli.param("draws"));
+	const std::vector<double> pheromone_row = {1, 2, 0.5, 4, 1, 3, 0.2, 5, 1, 1};
+	// Node 0 is the current node, 3, 6 and 9 still have open dependencies
+	const std::vector<int> allowed = {-1, 0, 0, 1, 0, 0, 2, 0, 0, 1};
+
+	std::filesystem::path problem_file = std::filesystem::temp_directory_path() / "microbench-selection.sop";
+	writeSyntheticProblem(problem_file, size, 0.0, params.random_seed);
+	Problem problem(problem_file);
+	std::filesystem::remove(problem_file);
+
+	SelectionProbe<SequentialOptimizer> roulette(problem, params, pheromone_row);
+	SelectionProbe<GumbelCpuOptimizer> gumbel(problem, params, pheromone_row);
+	const std::vector<double> expected = roulette.expected(allowed);
+
+	bool passed = true;
+	auto check = [&](const std::string& implementation, const std::vector<size_t>& counts) {
+		size_t dof;
+		double statistic = chiSquare(counts, expected, draws, dof);
+		double p = chiSquarePValue(statistic, dof);
+		std::cout
+			<< std::left << std::setw(14) << "gumbel-check"
+			<< std::setw(10) << implementation
+			<< "draws=" << std::setw(9) << draws
+			<< "chi2=" << std::setw(12) << statistic
+			<< "dof=" << std::setw(4) << dof
+			<< "p=" << p
+			<< (p < 0.001 ? "  FAILED" : "") << "\n";
+		passed = passed && p >= 0.001;
+	};
+	check("roulette", roulette.draw(allowed, draws, params.random_seed));
+	check("gumbelcpu", gumbel.draw(allowed, draws, params.random_seed));
+	if (device) {
+		AntParams block_params = params;
+		block_params.variant_args = VariantArgs("ants=1");
+		BlockColony blocks(problem, block_params, cli.param("kernels"));
+		blocks.prepare();
+		check("gumbel", blocks.gumbelDraws(roulette.weights(), allowed, draws, params.random_seed));
+	}
+	return passed;
+}
+
+AntParams default_params() {
+	AntParams params;
+	params.alpha = 0.5;
+	params.beta = 0.5;
+	params.q = 100;
+	params.rho = 0.5;
+
+	params.initial_pheromone = 1;
+	params.min_pheromone = 0.01;
+	params.max_pheromone = 100;
+
+	params.zero_weight = 0.001;
+	params.random_seed = std::hash<std::string>{}(cli.param("seed"));
+
+	params.kernel_cache_directory = "";
+	return params;
+}
+
+int main(int argc, char* argv[]) {
+	cli.addFlag("help", "Prints this help message", {"h"});
+	cli.addParameter("sizes", "Space separated problem sizes (nodes) to run every block on", {"n"}, "64 128 256 512 1024");
+	cli.addParameter("ants", "Space separated ant counts for the per-ant blocks, one per node if empty", {});
+	cli.addParameter("blocks", "Space separated blocks to run, all if empty: parse visibility depmask roulette release release-mask update best-ant. "
+		"gumbel-check only runs when listed and exits with a failure if a selection (roulette, gumbelcpu, gumbel.cl) does not fit its expected distribution");
+	cli.addParameter("samples", "Measured runs per block", {}, "200");
+	cli.addParameter("warmup", "Unmeasured runs before the measured ones", {}, "10");
+	cli.addParameter("draws", "Selections per implementation of gumbel-check", {}, "200000");
+	cli.addParameter("density", "Probability of a node depending on an earlier one in the synthetic problems", {}, "0.05");
+	cli.addParameter("seed", "Controls the synthetic problems and random-number-generator seeds", {}, "thomas");
+	cli.addParameter("pin", "Pin the benchmark to this CPU core (Linux)");
+	cli.addFlag("host-only", "Skip the OpenCL kernels, e.g. without a device");
+	cli.addParameter("kernels", "Directory of blocks.cl", {"k"}, "./src/microbench");
+	cli.addParameter("output", "Also write the results to this file", {"o"});
+	cli.addFlag("append", "Append to the file specified by --output instead of overwriting it. Used only when --output is specified", {"a"});
+
+	cli.parse(argc, argv);
+
+	if (cli.flag("help")) {
+		std::cout
+			<< "Ant Colony Optimization -- building block microbenchmarks\n"
+			<< "Usage:\n"
+			<< "  microbench [flags]\n\n"
+			<< "Flags:"
+			<< cli.help()
+			<< std::endl;
+		return EXIT_SUCCESS;
+	}
+
+	if (!cli.param("pin").empty()) {
+		std::string error;
+		if (!pin_to_core(std::stoi(cli.param("pin")), error)) {
+			std::cerr << "Could not pin to core " << cli.param("pin") << ": " << error << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::ofstream csv;
+	if (!cli.param("output").empty()) {
+		std::filesystem::path path = cli.param("output");
+		bool write_header = !cli.flag("append") || !std::filesystem::exists(path);
+		csv.open(path, cli.flag("append") ? std::ios_base::app : std::ios_base::out);
+		if (write_header) {
+			const char sep = ';';
+			csv
+				<< "block" << sep
+				<< "implementation" << sep
+				<< "n" << sep
+				<< "ants" << sep
+				<< "samples" << sep
+				<< "min_us" << sep
+				<< "avg_us" << sep
+				<< "stddev_us" << sep
+				<< "p50_us" << sep
+				<< "p90_us" << sep
+				<< "p99_us" << sep
+				<< "max_us" << "\n";
+		}
+	}
+
+	const bool device = !cli.flag("host-only");
+	const AntParams params = default_params();
+	bool checks_passed = true;
+	if ((" " + cli.param("blocks") + " ").find(" gumbel-check ") != std::string::npos) {
+		try {
+			checks_passed = selection_check(params, device);
+		}
+		catch (const std::exception& e) {
+			std::cerr << e.what() << "\nRun with --host-only to skip the OpenCL kernels" << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (cli.param("blocks") == "gumbel-check") {
+			return checks_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	const double density = std::stod(cli.param("density"));
+	for (size_t size : parse_sizes(cli.param("sizes"))) {
+		if (size < 2) {
+			std::cerr << "Problem sizes need at least 2 nodes" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		std::filesystem::path problem_file = std::filesystem::temp_directory_path() / ("microbench" + std::to_string(size) + ".sop");
+		writeSyntheticProblem(problem_file, size, density, params.random_seed);
+		Problem problem(problem_file);
+		if (selected("parse")) {
+			report(csv, "parse", "cpu", size, 0, measure_host([&problem_file]() {
+				Problem parsed(problem_file);
+				keep(parsed.weights.adjacency_matrix.data.data());
+			}));
+		}
+		std::filesystem::remove(problem_file);
+
+		std::vector<size_t> ant_counts = parse_sizes(cli.param("ants"));
+		if (ant_counts.empty()) {
+			ant_counts.push_back(size);
+		}
+		for (size_t ants : ant_counts) {
+			AntParams block_params = params;
+			block_params.variant_args = VariantArgs("ants=" + std::to_string(ants));
+			BlockColony blocks(problem, block_params, cli.param("kernels"));
+			if (device) {
+				try {
+					blocks.prepare();
+				}
+				catch (const std::exception& e) {
+					std::cerr << e.what() << "\nRun with --host-only to skip the OpenCL kernels" << std::endl;
+					return EXIT_FAILURE;
+				}
+			}
+
+			// Blocks independent of the ant count run with the first one only
+			if (ants == ant_counts.front()) {
+				if (selected("visibility")) {
+					report(csv, "visibility", "cpu", size, 0, measure_host([&blocks]() { keep(blocks.getVisibility().adjacency_matrix.data.data()); }));
+				}
+				if (selected("depmask")) {
+					report(csv, "depmask", "cpu", size, 0, measure_host([&blocks]() { keep(blocks.getDependencyMask(false).data()); }));
+				}
+				if (selected("update")) {
+					report(csv, "update", "cpu", size, 0, measure_host([&blocks]() { blocks.updatePheromone(); }));
+					if (device) {
+						report(csv, "update", "opencl", size, 0, measure([&blocks]() { return blocks.launchUpdatePheromone(); }));
+					}
+				}
+			}
+
+			if (selected("roulette")) {
+				report(csv, "roulette", "cpu", size, ants, measure_host([&blocks]() { blocks.roulette(); }));
+				if (device) {
+					report(csv, "roulette", "opencl", size, ants, measure([&blocks]() { return blocks.launchRoulette(); }));
+				}
+			}
+			if (selected("release")) {
+				report(csv, "release", "cpu", size, ants, measure_host([&blocks]() { blocks.releaseCounters(); }));
+				if (device) {
+					report(csv, "release", "opencl", size, ants, measure([&blocks]() { return blocks.launchReleaseCounters(); }));
+				}
+			}
+			if (selected("release-mask")) {
+				report(csv, "release-mask", "cpu", size, ants, measure_host([&blocks]() { blocks.releaseMask(); }));
+				if (device) {
+					report(csv, "release-mask", "opencl", size, ants, measure([&blocks]() { return blocks.launchReleaseMask(); }));
+				}
+			}
+			if (selected("best-ant")) {
+				report(csv, "best-ant", "cpu", size, ants, measure_host([&blocks]() { keep(blocks.bestAnt()); }));
+				if (device) {
+					report(csv, "best-ant", "opencl", size, ants, measure([&blocks]() { return blocks.launchBestAnt(); }));
+				}
+			}
+		}
+	}
+	std::cout.flush();
+	return checks_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "../variants/sequential.hpp"
+#include "../variants/gumbelcpu.hpp"
+
+/*
+Draws next nodes through the choose_next of a sequential colony, from node 0 with a fixed pheromone row
+*/
+template<typename Colony>
+class SelectionProbe: public Colony {
+public:
+	/*
+	@param pheromone_row : Pheromone on the edges leaving node 0, one per node
+	*/
+	SelectionProbe(const Problem& problem, AntParams params, const std::vector<double>& pheromone_row)
+	:	Colony(problem, params) {
+		this->prepare();
+		std::copy(pheromone_row.begin(), pheromone_row.end(), &this->pheromone.edge(0, 0));
+		this->pheromoneUpdated();
+	}
+
+	/*
+	@param allowed : Allowed counters of the ant, only candidates at 0 may be drawn
+	@return How often every node was drawn, the last entry counts failed draws
+	*/
+	std::vector<size_t> draw(const std::vector<int>& allowed, size_t draws, uint32_t seed) {
+		typename Colony::Ant ant;
+		ant.current_node = 0;
+		ant.allowed_nodes = allowed;
+		ant.random_generator.seed(seed);
+
+		std::vector<size_t> counts(this->problem.size() + 1, 0);
+		for (size_t i = 0; i < draws; i++) {
+			int next = this->choose_next(ant);
+			counts[next < 0 ? counts.size() - 1 : next]++;
+		}
+		return counts;
+	}
+
+	/*
+	Weight of every edge from node 0, pheromone^alpha * visibility
+	*/
+	std::vector<double> weights() {
+		std::vector<double> row(this->problem.size());
+		for (size_t to = 0; to < row.size(); to++) {
+			row[to] = this->edge_value(0, to);
+		}
+		return row;
+	}
+
+	/*
+	Share of every node in the draws: pheromone^alpha * visibility among the allowed candidates
+	*/
+	std::vector<double> expected(const std::vector<int>& allowed) {
+		std::vector<double> shares(this->problem.size(), 0.0);
+		double sum = 0.0;
+		for (size_t to = 0; to < shares.size(); to++) {
+			if (allowed[to] == 0) {
+				shares[to] = this->edge_value(0, to);
+				sum += shares[to];
+			}
+		}
+		for (double& share : shares) {
+			share /= sum;
+		}
+		return shares;
+	}
+};
+
+/*
+Upper-tail probability of Pearson's chi-square statistic with `dof` degrees of freedom,
+by the Wilson-Hilferty normal approximation
+*/
+inline double chiSquarePValue(double statistic, size_t dof) {
+	const double k = static_cast<double>(dof);
+	double z = (std::cbrt(statistic / k) - (1.0 - 2.0 / (9.0 * k))) / std::sqrt(2.0 / (9.0 * k));
+	return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+/*
+Pearson's chi-square statistic of `counts` against `expected` shares, over the candidates with a share.
+Failed draws count against the fit through their own cell with an expected count of 0.5.
+@param dof : Set to the degrees of freedom of the statistic
+*/
+inline double chiSquare(const std::vector<size_t>& counts, const std::vector<double>& expected, size_t draws, size_t& dof) {
+	double statistic = 0.0;
+	size_t cells = 0;
+	for (size_t i = 0; i < expected.size(); i++) {
+		if (expected[i] > 0.0) {
+			double want = expected[i] * draws;
+			statistic += (counts[i] - want) * (counts[i] - want) / want;
+			cells++;
+		}
+		else if (counts[i] > 0) {
+			// Drawn although not allowed
+			statistic += counts[i] * counts[i] / 0.5;
+		}
+	}
+	statistic += counts.back() * counts.back() / 0.5;
+	dof = cells > 1 ? cells - 1 : 1;
+	return statistic;
+}
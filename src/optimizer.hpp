@@ -1,7 +1,13 @@
 #pragma once
 
+#include <limits>
+#include <stdexcept>
+
+#include "convergence.hpp"
+#include "memory.hpp"
 #include "params.hpp"
 #include "problem.hpp"
+#include "roofline.hpp"
 
 class AntOptimizer {
 protected:
@@ -9,15 +15,60 @@ protected:
 	AntParams params;	
 public:
 	int best_route_length = std::numeric_limits<int>::max();
+	unsigned int rounds_per_launch = 1;
+	// Ants per round, `ants=<count>` colony argument (default: one per node)
+	size_t ant_count;
+	ConvergenceLog convergence;
+	MemoryAccount host_memory;
+	MemoryAccount device_memory;
 
 	AntOptimizer(const Problem& problem, AntParams params)
-	: problem(problem), params(params) {}
+	: problem(problem), params(params), ant_count(params.variant_args.get<size_t>("ants", problem.size())) {
+		if (ant_count == 0) {
+			throw std::invalid_argument("Colony argument ants must be at least 1");
+		}
+		// Kernels take the ant count as cl_int
+		if (ant_count > static_cast<size_t>(std::numeric_limits<int>::max())) {
+			throw std::invalid_argument("Colony argument ants must be at most " + std::to_string(std::numeric_limits<int>::max()));
+		}
+	}
 
 	virtual ~AntOptimizer() = default;
 
 	virtual void prepare() = 0;
 	virtual void optimize(unsigned int rounds) = 0;
 
+	/*
+	Global memory traffic and operations of one round, counted analytically.
+	The default models the basic construction: every ant step scans one row of probabilities,
+	writes and rereads a sample per candidate and checks the allowed counters and dependencies.
+	The update evaporates the pheromone and recomputes probabilities = pheromone^alpha * visibility.
+	*/
+	virtual RoundCost roundCost() const {
+		const double n = problem.size();
+		const double steps = ant_count * (n - 1);
+		RoundCost cost;
+		// probabilities, sample written and reread, allowed counters, dependencies
+		cost.advance.bytes = steps * n * (sizeof(double) + 2 * sizeof(double) + sizeof(int) + sizeof(int));
+		// Sum of the samples, then the roulette subtracts them again
+		cost.advance.flops = steps * 2 * n;
+		cost.evaluate.bytes = ant_count * sizeof(int) + n * sizeof(int);
+		// pheromone read and written, visibility read, probabilities written
+		cost.update.bytes = n * n * 4 * sizeof(double);
+		// Evaporation, pow and multiplication per edge, one deposit per route edge
+		cost.update.flops = n * n * 3 + (n - 1);
+		return cost;
+	}
+
+	/*
+	Memory bandwidth in bytes per second of the hardware the stages run on, from a STREAM-like probe
+	*/
+	virtual double measureBandwidth() {
+		return streamTriadBandwidth();
+	}
+
 	static constexpr const char* static_name = "abstract";
 	static constexpr const char* static_params = "";
+	// Colony arguments understood by every variant
+	static constexpr const char* common_params = "ants=<count>";
 };
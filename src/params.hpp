@@ -3,6 +3,8 @@
 #include <unordered_map>
 #include <string>
 
+#include "variant_args.hpp"
+
 struct AntParams {
 	double alpha;
 	double beta;
@@ -16,5 +18,7 @@ struct AntParams {
 	double zero_weight;
 	uint32_t random_seed;
 
-	std::string variant_args;
+	VariantArgs variant_args;
+	std::string kernel_directory;
+	std::string kernel_cache_directory;
 };
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+Hardware counters of the calling thread, read as one perf_event_open group so all values cover the same interval.
+Counters the CPU or kernel does not offer are left out of the group and read as 0.
+Opening fails without a leader (cycles), e.g. if perf_event_paranoid forbids it or outside Linux.
+*/
+struct PerfCounters {
+	enum Counter { Cycles, Instructions, LlcMisses, BranchMisses, DtlbMisses };
+	static constexpr size_t count = 5;
+	static constexpr std::array<const char*, count> names = {
+		"cycles", "instructions", "llc-misses", "branch-misses", "dtlb-misses"
+	};
+
+	using Values = std::array<uint64_t, count>;
+
+	struct Reading {
+		Values values {};
+		// Time the group was enabled / actually counting, differ if the kernel multiplexed it
+		uint64_t enabled = 0;
+		uint64_t running = 0;
+	};
+
+	std::array<int, count> fds;
+	std::string error;
+
+	PerfCounters() {
+		fds.fill(-1);
+	}
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	~PerfCounters() {
+#ifdef __linux__
+		for (int fd : fds) {
+			if (fd >= 0) {
+				close(fd);
+			}
+		}
+#endif
+	}
+
+	bool is_open() const {
+		return fds[Cycles] >= 0;
+	}
+
+	bool open() {
+#ifdef __linux__
+		for (size_t i = 0; i < count; i++) {
+			perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = type(static_cast<Counter>(i));
+			attr.config = config(static_cast<Counter>(i));
+			attr.disabled = i == Cycles;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+			fds[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, fds[Cycles], 0));
+			if (fds[Cycles] < 0) {
+				error = std::string("perf_event_open: ") + std::strerror(errno);
+				return false;
+			}
+		}
+		ioctl(fds[Cycles], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(fds[Cycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		return true;
+#else
+		error = "hardware counters need Linux perf_event_open";
+		return false;
+#endif
+	}
+
+	Reading read() const {
+		Reading reading;
+#ifdef __linux__
+		if (!is_open()) {
+			return reading;
+		}
+		// nr, time_enabled, time_running, then one value per group member in order of opening
+		uint64_t buffer[3 + count];
+		if (::read(fds[Cycles], buffer, sizeof(buffer)) < static_cast<ssize_t>(3 * sizeof(uint64_t))) {
+			return reading;
+		}
+		reading.enabled = buffer[1];
+		reading.running = buffer[2];
+		size_t member = 0;
+		for (size_t i = 0; i < count && member < buffer[0]; i++) {
+			if (fds[i] >= 0) {
+				reading.values[i] = buffer[3 + member++];
+			}
+		}
+#endif
+		return reading;
+	}
+
+	/*
+	Counts between two readings, scaled up if the group was only counting part of the time
+	*/
+	static Values delta(const Reading& start, const Reading& stop) {
+		Values result {};
+		uint64_t running = stop.running - start.running;
+		if (running == 0) {
+			return result;
+		}
+		double scale = static_cast<double>(stop.enabled - start.enabled) / running;
+		for (size_t i = 0; i < count; i++) {
+			result[i] = static_cast<uint64_t>((stop.values[i] - start.values[i]) * scale);
+		}
+		return result;
+	}
+
+private:
+#ifdef __linux__
+	static uint32_t type(Counter counter) {
+		return counter == LlcMisses || counter == DtlbMisses ? PERF_TYPE_HW_CACHE : PERF_TYPE_HARDWARE;
+	}
+
+	static uint64_t config(Counter counter) {
+		const uint64_t read_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		switch (counter) {
+		case Cycles: return PERF_COUNT_HW_CPU_CYCLES;
+		case Instructions: return PERF_COUNT_HW_INSTRUCTIONS;
+		case LlcMisses: return PERF_COUNT_HW_CACHE_LL | read_miss;
+		case BranchMisses: return PERF_COUNT_HW_BRANCH_MISSES;
+		case DtlbMisses: return PERF_COUNT_HW_CACHE_DTLB | read_miss;
+		}
+		return 0;
+	}
+#endif
+};
@@ -1,29 +1,82 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
 #include <vector>
 #include <string>
 #include <unordered_map>
 
+#include "perf_counters.hpp"
 
+
+/*
+Sections are recorded as raw tick counts into a preallocated buffer of the calling thread.
+Pairing starts with stops and collecting the measurements happens off the hot path,
+when a buffer is full, when its thread exits or when measurements are queried.
+Queries must not run while other threads are still recording.
+*/
 struct Profiler {
-	using Clock = std::chrono::high_resolution_clock;
+	using Clock = std::chrono::steady_clock;
 	using Duration = Clock::duration;
 	using Timepoint = Clock::time_point;
 	using Identifier = std::string;
 
-	struct Timer {
-		Timepoint start_time;
-		std::string comment = "";
-		bool is_active = false;
+	/*
+	Section names of up to four characters ("opts", "adva", ...) packed into an integer.
+	Literals are packed at compile time, so the hot path never hashes a string.
+	*/
+	struct SectionId {
+		uint32_t value = 0;
+
+		constexpr SectionId() = default;
+
+		explicit constexpr SectionId(uint32_t value)
+		: value(value) {}
+
+		template<size_t N>
+		constexpr SectionId(const char (&name)[N])
+		: value(pack(name, N - 1)) {
+			static_assert(N <= 5, "Profiler section names have at most four characters");
+		}
+
+		SectionId(const Identifier& name)
+		: value(pack(name.c_str(), name.size())) {
+			if (name.size() > 4) {
+				throw std::invalid_argument("Profiler section names have at most four characters: " + name);
+			}
+		}
+
+		Identifier name() const {
+			Identifier result;
+			for (int i = 0; i < 4 && (value >> (8 * i)) != 0; i++) {
+				result += static_cast<char>((value >> (8 * i)) & 0xFF);
+			}
+			return result;
+		}
+
+		friend bool operator==(SectionId lhs, SectionId rhs) {
+			return lhs.value == rhs.value;
+		}
+
+	private:
+		static constexpr uint32_t pack(const char* name, size_t length) {
+			uint32_t packed = 0;
+			for (size_t i = 0; i < length && i < 4; i++) {
+				packed |= static_cast<uint32_t>(static_cast<unsigned char>(name[i])) << (8 * i);
+			}
+			return packed;
+		}
 	};
 
 	struct Measurement {
 		Duration duration;
-		std::string comment;
 
-		Measurement(Duration d, std::string c)
-		: duration(d), comment(c) {}
+		Measurement(Duration d)
+		: duration(d) {}
 
 		template<typename T, typename Resolution = std::ratio<1>>
 		T value() {
@@ -36,84 +89,476 @@ struct Profiler {
 	};
 	using MeasurementList = std::vector<Measurement>;
 
+	/*
+	Log-bucketed histogram in the style of HdrHistogram: every power of two of clock ticks is split
+	into sub_buckets linear buckets, so a bucket is never wider than 1 / sub_buckets of its values.
+	Count, mean, variance, min and max are tracked exactly alongside.
+	*/
+	struct Histogram {
+		static constexpr int sub_bucket_bits = 4;
+		static constexpr Clock::rep sub_buckets = 1 << sub_bucket_bits;
+
+		struct Bucket {
+			Duration lower;
+			Duration upper;
+			uint64_t count;
+		};
+
+		std::vector<uint64_t> counts;
+		uint64_t count = 0;
+		Duration min = Duration::max();
+		Duration max = Duration::min();
+		Duration sum = Duration::zero();
+		// Welford's running mean and sum of squared deviations, in ticks
+		double mean = 0.0;
+		double m2 = 0.0;
+
+		static size_t bucket_index(Clock::rep ticks) {
+			if (ticks < sub_buckets) {
+				return static_cast<size_t>(std::max<Clock::rep>(ticks, 0));
+			}
+			int exponent = sub_bucket_bits;
+			while ((ticks >> (exponent + 1)) != 0) {
+				exponent++;
+			}
+			int shift = exponent - sub_bucket_bits;
+			return (shift + 1) * sub_buckets + ((ticks >> shift) - sub_buckets);
+		}
+
+		static Bucket bucket_bounds(size_t index) {
+			if (index < static_cast<size_t>(sub_buckets)) {
+				return { Duration(index), Duration(index + 1), 0 };
+			}
+			int shift = index / sub_buckets - 1;
+			Clock::rep lower = (sub_buckets + index % sub_buckets) << shift;
+			return { Duration(lower), Duration(lower + (Clock::rep(1) << shift)), 0 };
+		}
+
+		void add(Duration duration) {
+			size_t index = bucket_index(duration.count());
+			if (index >= counts.size()) {
+				counts.resize(index + 1, 0);
+			}
+			counts[index]++;
+
+			count++;
+			min = std::min(min, duration);
+			max = std::max(max, duration);
+			sum += duration;
+			double delta = duration.count() - mean;
+			mean += delta / count;
+			m2 += delta * (duration.count() - mean);
+		}
+
+		Duration stddev() const {
+			return Duration(static_cast<Clock::rep>(count > 1 ? std::sqrt(m2 / (count - 1)) : 0.0));
+		}
+
+		/*
+		Nearest-rank percentile, q in [0, 1]. Reports the middle of the bucket holding the rank.
+		*/
+		Duration percentile(double q) const {
+			uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * count)));
+			uint64_t seen = 0;
+			for (size_t i = 0; i < counts.size(); i++) {
+				seen += counts[i];
+				if (seen >= rank) {
+					Bucket bucket = bucket_bounds(i);
+					return std::clamp(bucket.lower + (bucket.upper - bucket.lower) / 2, min, max);
+				}
+			}
+			return max;
+		}
+
+		std::vector<Bucket> buckets() const {
+			std::vector<Bucket> result;
+			for (size_t i = 0; i < counts.size(); i++) {
+				if (counts[i] != 0) {
+					Bucket bucket = bucket_bounds(i);
+					bucket.count = counts[i];
+					result.push_back(bucket);
+				}
+			}
+			return result;
+		}
+	};
+
 	struct Analysis {
 		Measurement min;
 		Measurement max;
 		Measurement avg;
+		Measurement stddev;
+		Measurement p50;
+		Measurement p90;
+		Measurement p99;
+		Measurement p999;
+		uint64_t count;
+		Histogram histogram;
+		// Hardware counter totals over the `counted` measurements taken while counting
+		PerfCounters::Values counters {};
+		uint64_t counted = 0;
 
-		Analysis(Measurement min, Measurement max, Measurement avg)
-		: min(min), max(max), avg(avg) {}
+		Analysis(const Histogram& histogram, Measurement p50, Measurement p90, Measurement p99, Measurement p999)
+		:	min(histogram.min), max(histogram.max), avg(histogram.sum / histogram.count), stddev(histogram.stddev()),
+			p50(p50), p90(p90), p99(p99), p999(p999), count(histogram.count), histogram(histogram) {}
 	};
 
-	std::unordered_map<Identifier, Timer> active_timers;
-	std::unordered_map<Identifier, MeasurementList> measurements;
+	/*
+	All measurements of one section. In streaming mode only the first sample is kept,
+	everything else goes into the histogram alone.
+	*/
+	struct Section {
+		MeasurementList samples;
+		Histogram histogram;
+		PerfCounters::Values counters {};
+		uint64_t counted = 0;
+
+		void add(Duration duration, bool streaming) {
+			if (!streaming || samples.empty()) {
+				samples.emplace_back(duration);
+			}
+			histogram.add(duration);
+		}
+	};
+
+	enum class EventKind : uint32_t { Start, Stop, Record };
+
+	struct Event {
+		uint32_t section;
+		EventKind kind;
+		// Clock ticks since epoch for Start / Stop, a duration for Record
+		Clock::rep ticks;
+	};
 
-	void start_timer(const Identifier & id, std::string comment = "") {
-		Timer& timer = active_timers[id];
-		if (timer.is_active) { return; }
+	/*
+	A completed host section, kept for the trace while tracing
+	*/
+	struct Span {
+		SectionId section;
+		uint32_t thread;
+		Timepoint start;
+		Duration duration;
+	};
+
+	/*
+	A device command with its OpenCL profiling timestamps, already moved onto the host clock
+	*/
+	struct DeviceSpan {
+		std::string name;
+		// Queue the command ran on, one trace track each
+		uint32_t queue;
+		Timepoint queued;
+		Timepoint submit;
+		Timepoint start;
+		Timepoint end;
+	};
+
+	/*
+	Per-thread event buffer, drained into the profiler when full
+	*/
+	struct ThreadBuffer {
+		static constexpr size_t capacity = 1 << 14;
+
+		// Trace track of the thread, in order of its first recording
+		uint32_t thread = 0;
+		std::vector<Event> events;
+		// One counter reading per event while counting
+		std::vector<PerfCounters::Reading> readings;
+		PerfCounters counters;
+		bool counters_opened = false;
+
+		struct OpenSection {
+			Clock::rep ticks;
+			PerfCounters::Reading reading;
+		};
+		// Starts without a stop yet, only touched while draining
+		std::unordered_map<uint32_t, OpenSection> open;
+
+		ThreadBuffer() {
+			events.reserve(capacity);
+			default_profiler.attach(this);
+		}
+
+		~ThreadBuffer() {
+			default_profiler.detach(this);
+		}
 
-		timer.comment = comment;
-		timer.is_active = true;
-		timer.start_time = Clock::now();
+		void push(uint32_t section, EventKind kind, Clock::rep ticks) {
+			if (default_profiler.counting) {
+				if (!counters_opened) {
+					readings.reserve(capacity);
+					counters.open();
+					counters_opened = true;
+				}
+				readings.push_back(kind == EventKind::Record ? PerfCounters::Reading() : counters.read());
+			}
+			events.push_back({ section, kind, ticks });
+			if (events.size() == capacity) {
+				default_profiler.drain(*this);
+			}
+		}
+	};
+
+	static inline thread_local ThreadBuffer thread_buffer;
+
+	std::mutex mutex;
+	std::vector<ThreadBuffer*> buffers;
+	std::unordered_map<uint32_t, Section> measurements;
+	bool streaming = false;
+	bool counting = false;
+
+	bool tracing = false;
+	uint32_t thread_count = 0;
+	std::vector<Span> spans;
+	std::vector<DeviceSpan> device_spans;
+
+	// Own overhead: events recorded and time spent draining them
+	size_t event_count = 0;
+	Duration drain_time = Duration::zero();
+
+	void attach(ThreadBuffer* buffer) {
+		std::lock_guard<std::mutex> lock(mutex);
+		buffer->thread = thread_count++;
+		buffers.push_back(buffer);
 	}
 
-	void stop_timer(const Identifier & id, std::string comment = "") {
-		Timepoint stop_time = Clock::now();
-		Timer& timer = active_timers[id];
-		if (!timer.is_active) { return; }
+	void detach(ThreadBuffer* buffer) {
+		drain(*buffer);
+		std::lock_guard<std::mutex> lock(mutex);
+		buffers.erase(std::remove(buffers.begin(), buffers.end(), buffer), buffers.end());
+	}
 
-		measurements[id].emplace_back(
-			stop_time - timer.start_time,
-			comment.empty() ? timer.comment : comment
-		);
-		timer.is_active = false;
+	void drain(ThreadBuffer& buffer) {
+		Timepoint drain_start = Clock::now();
+		std::lock_guard<std::mutex> lock(mutex);
+		const bool counted = buffer.counters.is_open() && buffer.readings.size() == buffer.events.size();
+		for (size_t i = 0; i < buffer.events.size(); i++) {
+			const Event& event = buffer.events[i];
+			switch (event.kind) {
+			case EventKind::Start:
+				// A section already running keeps its first start
+				buffer.open.emplace(event.section, ThreadBuffer::OpenSection {
+					event.ticks, counted ? buffer.readings[i] : PerfCounters::Reading() });
+				break;
+			case EventKind::Stop: {
+				auto it = buffer.open.find(event.section);
+				if (it == buffer.open.end()) { break; }
+				Section& section = measurements[event.section];
+				Duration duration(event.ticks - it->second.ticks);
+				section.add(duration, streaming);
+				if (counted && it->second.reading.running != 0) {
+					PerfCounters::Values delta = PerfCounters::delta(it->second.reading, buffer.readings[i]);
+					for (size_t c = 0; c < PerfCounters::count; c++) {
+						section.counters[c] += delta[c];
+					}
+					section.counted++;
+				}
+				if (tracing) {
+					spans.push_back({ SectionId(event.section), buffer.thread, Timepoint(Duration(it->second.ticks)), duration });
+				}
+				buffer.open.erase(it);
+				break;
+			}
+			case EventKind::Record:
+				measurements[event.section].add(Duration(event.ticks), streaming);
+				break;
+			}
+		}
+		event_count += buffer.events.size();
+		buffer.events.clear();
+		buffer.readings.clear();
+		drain_time += Clock::now() - drain_start;
 	}
 
-	Analysis get_analysis(const Identifier& id) {
-		auto it = measurements.at(id).begin();
-		auto itend = measurements.at(id).end();
-		size_t count = measurements.at(id).size();
-		Measurement
-			min = *it,
-			max = *it,
-			average = Measurement(it->duration, "");
-		it++;
-		for (;it != itend; it++) {
-			min = std::min(*it, min);
-			max = std::max(*it, max);
-			average.duration += it->duration;
+	/*
+	Drains every attached thread buffer
+	*/
+	void collect() {
+		std::vector<ThreadBuffer*> attached;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			attached = buffers;
 		}
-		average.duration /= count;
-		return Analysis(min, max, average);
+		for (ThreadBuffer* buffer : attached) {
+			drain(*buffer);
+		}
+	}
+
+	/*
+	Percentiles are exact while every sample is kept and come from the histogram in streaming mode
+	*/
+	Analysis get_analysis(SectionId id) {
+		const Section& section = measurements.at(id.value);
+		const Histogram& histogram = section.histogram;
+		Analysis analysis = section.samples.size() != histogram.count
+			? Analysis(histogram,
+				histogram.percentile(0.5), histogram.percentile(0.9),
+				histogram.percentile(0.99), histogram.percentile(0.999))
+			: exact_analysis(section);
+		analysis.counters = section.counters;
+		analysis.counted = section.counted;
+		return analysis;
+	}
+
+	static Analysis exact_analysis(const Section& section) {
+		MeasurementList sorted = section.samples;
+		std::sort(sorted.begin(), sorted.end());
+		auto percentile = [&sorted](double q) {
+			size_t rank = std::max<size_t>(1, static_cast<size_t>(std::ceil(q * sorted.size())));
+			return sorted[std::min(rank, sorted.size()) - 1];
+		};
+		return Analysis(section.histogram, percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999));
+	}
+
+	/*
+	Cost of recording one event on this thread, measured on a throwaway buffer
+	*/
+	static Duration event_cost() {
+		constexpr size_t samples = 4096;
+		std::vector<Event> events;
+		events.reserve(samples);
+		Timepoint begin = Clock::now();
+		for (size_t i = 0; i < samples; i++) {
+			events.push_back({ 0, EventKind::Start, Clock::now().time_since_epoch().count() });
+		}
+		return (Clock::now() - begin) / samples;
 	}
 
 	static Profiler default_profiler;
 
-	static void start(const Identifier & id, std::string comment = "") {
-		default_profiler.start_timer(id, comment);
+	static void start(SectionId id) {
+		thread_buffer.push(id.value, EventKind::Start, Clock::now().time_since_epoch().count());
 	}
 
-	static void stop(const Identifier & id, std::string comment = "") {
-		default_profiler.stop_timer(id, comment);
+	static void stop(SectionId id) {
+		thread_buffer.push(id.value, EventKind::Stop, Clock::now().time_since_epoch().count());
 	}
 
-	static MeasurementList& at(const Identifier & id) {
-		return default_profiler.measurements.at(id);
+	/*
+	Adds a measurement that was taken elsewhere, e.g. from OpenCL event timestamps
+	*/
+	static void record(SectionId id, Duration duration) {
+		thread_buffer.push(id.value, EventKind::Record, duration.count());
 	}
 
-	static Measurement& first(const Identifier & id) {
+	static bool contains(SectionId id) {
+		default_profiler.collect();
+		return default_profiler.measurements.count(id.value) != 0;
+	}
+
+	static MeasurementList& at(SectionId id) {
+		default_profiler.collect();
+		return default_profiler.measurements.at(id.value).samples;
+	}
+
+	static Measurement& first(SectionId id) {
 		return at(id).front();
 	}
 
-	static Analysis analyze(const Identifier & id) {
+	/*
+	Drops all measurements, spans and sections still open, e.g. between the runs of a benchmark.
+	No other thread may be recording.
+	*/
+	static void reset() {
+		default_profiler.collect();
+		std::lock_guard<std::mutex> lock(default_profiler.mutex);
+		for (ThreadBuffer* buffer : default_profiler.buffers) {
+			buffer->open.clear();
+		}
+		default_profiler.measurements.clear();
+		default_profiler.spans.clear();
+		default_profiler.device_spans.clear();
+		default_profiler.event_count = 0;
+		default_profiler.drain_time = Duration::zero();
+	}
+
+	/*
+	Keeps only a histogram and the first sample of every section from now on,
+	so long runs do not grow with the number of rounds
+	*/
+	static void set_streaming(bool streaming) {
+		std::lock_guard<std::mutex> lock(default_profiler.mutex);
+		default_profiler.streaming = streaming;
+	}
+
+	/*
+	Reads hardware counters at every start and stop of a section from now on, on each thread that records.
+	Section times then include the counter reads. Returns false and leaves counting off
+	if the calling thread cannot open the counters, with the reason in `error`.
+	*/
+	static bool set_counting(bool counting, std::string& error) {
+		if (counting) {
+			PerfCounters probe;
+			if (!probe.open()) {
+				error = probe.error;
+				return false;
+			}
+		}
+		std::lock_guard<std::mutex> lock(default_profiler.mutex);
+		default_profiler.counting = counting;
+		return true;
+	}
+
+	/*
+	Keeps every host section and device command with its timestamps from now on, see trace() and device_trace()
+	*/
+	static void set_tracing(bool tracing) {
+		std::lock_guard<std::mutex> lock(default_profiler.mutex);
+		default_profiler.tracing = tracing;
+	}
+
+	static bool is_tracing() {
+		return default_profiler.tracing;
+	}
+
+	/*
+	Adds a device command to the trace, ignored unless tracing
+	*/
+	static void record_device(DeviceSpan span) {
+		std::lock_guard<std::mutex> lock(default_profiler.mutex);
+		if (default_profiler.tracing) {
+			default_profiler.device_spans.push_back(std::move(span));
+		}
+	}
+
+	static const std::vector<Span>& trace() {
+		default_profiler.collect();
+		return default_profiler.spans;
+	}
+
+	static const std::vector<DeviceSpan>& device_trace() {
+		return default_profiler.device_spans;
+	}
+
+	static Analysis analyze(SectionId id) {
+		default_profiler.collect();
 		return default_profiler.get_analysis(id);
 	}
 
 	static std::vector<Identifier> measurement_keys() {
+		default_profiler.collect();
 		std::vector<Identifier> ids;
 		for (const auto& p : default_profiler.measurements) {
-			ids.push_back(p.first);
+			ids.push_back(section_name(p.first));
 		}
 		return ids;
 	}
+
+	/*
+	Estimated time the profiler itself took: recording every event plus draining the buffers
+	*/
+	static Duration overhead() {
+		default_profiler.collect();
+		return default_profiler.event_count * event_cost() + default_profiler.drain_time;
+	}
+
+	static size_t events_recorded() {
+		default_profiler.collect();
+		return default_profiler.event_count;
+	}
+
+private:
+	static Identifier section_name(uint32_t value) {
+		return SectionId(value).name();
+	}
 };
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+Round times and solution quality of one colony on one problem with one seed, over all repetitions of a bench
+*/
+struct BenchResult {
+	std::string colony;
+	std::string problem;
+	std::string seed;
+	unsigned int rounds = 0;
+	// Shortest route over all repetitions
+	int best_length = 0;
+	// Time of every measured round of every repetition in milliseconds
+	std::vector<double> round_ms;
+
+	bool same_run(const BenchResult& other) const {
+		return colony == other.colony && problem == other.problem && seed == other.seed;
+	}
+
+	static double median(std::vector<double> values) {
+		if (values.empty()) {
+			return 0.0;
+		}
+		std::sort(values.begin(), values.end());
+		size_t mid = values.size() / 2;
+		return values.size() % 2 == 1 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+	}
+
+	/*
+	One row per result, the round times space separated in the last column
+	*/
+	static void save(const std::filesystem::path& path, const std::vector<BenchResult>& results) {
+		std::ofstream file(path);
+		const char sep = ';';
+		file
+			<< "variant" << sep
+			<< "problem" << sep
+			<< "seed" << sep
+			<< "rounds" << sep
+			<< "best" << sep
+			<< "round_ms" << "\n";
+		for (const BenchResult& result : results) {
+			file
+				<< result.colony << sep
+				<< result.problem << sep
+				<< result.seed << sep
+				<< result.rounds << sep
+				<< result.best_length << sep;
+			for (size_t i = 0; i < result.round_ms.size(); i++) {
+				file << (i == 0 ? "" : " ") << result.round_ms[i];
+			}
+			file << "\n";
+		}
+	}
+
+	static std::vector<BenchResult> load(const std::filesystem::path& path) {
+		std::ifstream file(path);
+		if (!file) {
+			throw std::invalid_argument("Cannot read baseline " + path.string());
+		}
+		std::vector<BenchResult> results;
+		std::string line;
+		std::getline(file, line);
+		while (std::getline(file, line)) {
+			if (line.empty()) {
+				continue;
+			}
+			std::vector<std::string> fields;
+			std::istringstream row(line);
+			for (std::string field; std::getline(row, field, ';');) {
+				fields.push_back(field);
+			}
+			if (fields.size() != 6) {
+				throw std::invalid_argument("Malformed baseline row: " + line);
+			}
+
+			BenchResult result;
+			result.colony = fields[0];
+			result.problem = fields[1];
+			result.seed = fields[2];
+			result.rounds = std::stoul(fields[3]);
+			result.best_length = std::stoi(fields[4]);
+			std::istringstream times(fields[5]);
+			for (double ms; times >> ms;) {
+				result.round_ms.push_back(ms);
+			}
+			results.push_back(result);
+		}
+		return results;
+	}
+};
+
+/*
+One-sided Mann-Whitney U test: the probability of `current` ranking at least this high above `baseline`
+if both came from the same distribution. Normal approximation with tie and continuity correction,
+which holds for the hundreds of rounds of a bench.
+*/
+inline double mannWhitneyGreater(const std::vector<double>& current, const std::vector<double>& baseline) {
+	const double n1 = current.size();
+	const double n2 = baseline.size();
+	if (n1 == 0 || n2 == 0) {
+		return 1.0;
+	}
+
+	std::vector<std::pair<double, bool>> combined;
+	combined.reserve(current.size() + baseline.size());
+	for (double value : current) {
+		combined.emplace_back(value, true);
+	}
+	for (double value : baseline) {
+		combined.emplace_back(value, false);
+	}
+	std::sort(combined.begin(), combined.end());
+
+	// Ties share the average of their ranks
+	double current_rank_sum = 0.0;
+	double tie_term = 0.0;
+	for (size_t i = 0; i < combined.size();) {
+		size_t j = i;
+		while (j < combined.size() && combined[j].first == combined[i].first) {
+			j++;
+		}
+		double rank = (i + 1 + j) / 2.0;
+		for (size_t k = i; k < j; k++) {
+			if (combined[k].second) {
+				current_rank_sum += rank;
+			}
+		}
+		double ties = j - i;
+		tie_term += ties * ties * ties - ties;
+		i = j;
+	}
+
+	const double n = n1 + n2;
+	double u = current_rank_sum - n1 * (n1 + 1) / 2;
+	double variance = n1 * n2 / 12.0 * ((n + 1) - tie_term / (n * (n - 1)));
+	if (variance <= 0.0) {
+		return 1.0;
+	}
+	double z = (u - n1 * n2 / 2 - 0.5) / std::sqrt(variance);
+	return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+/*
+Global memory traffic and floating-point operations of one stage of a round.
+Transcendental functions (pow, log) count as one operation each.
+*/
+struct StageCost {
+	double bytes = 0.0;
+	double flops = 0.0;
+
+	/*
+	Operations per byte moved
+	*/
+	double intensity() const {
+		return bytes > 0.0 ? flops / bytes : 0.0;
+	}
+};
+
+struct RoundCost {
+	StageCost advance;
+	StageCost evaluate;
+	StageCost update;
+};
+
+/*
+Host memory bandwidth in bytes per second from the STREAM triad a[i] = b[i] + s * c[i],
+on arrays well beyond the last level cache. The best of a few repetitions counts,
+as in STREAM, and write-allocate traffic is not counted.
+*/
+inline double streamTriadBandwidth(size_t elements = 1 << 23, int repetitions = 5) {
+	std::vector<double> a(elements, 0.0);
+	std::vector<double> b(elements, 1.0);
+	std::vector<double> c(elements, 2.0);
+	const double scalar = 3.0;
+
+	double best = 0.0;
+	for (int r = 0; r < repetitions; r++) {
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < elements; i++) {
+			a[i] = b[i] + scalar * c[i];
+		}
+		std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+		// Keeps the loop from being optimized away
+		b[r % elements] = a[(r * 7919) % elements];
+		best = std::max(best, 3 * sizeof(double) * elements / seconds.count());
+	}
+	return best;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+/*
+Colony arguments of the form `key=value,key=value`, e.g. `-c gpumax:ants=4096,subgroup`.
+A key without value is a flag. Variants declare their keys in `static_params` in the same form,
+with a short description as value, e.g. "ants=<count>,subgroup".
+*/
+struct VariantArgs {
+private:
+	std::unordered_map<std::string, std::string> values;
+	std::vector<std::string> order;
+public:
+	VariantArgs() = default;
+
+	VariantArgs(const std::string& args) {
+		size_t start = 0;
+		while (start <= args.size()) {
+			size_t end = args.find_first_of(',', start);
+			if (end == std::string::npos) {
+				end = args.size();
+			}
+			std::string item = args.substr(start, end - start);
+			start = end + 1;
+			if (item.empty()) {
+				continue;
+			}
+
+			size_t eqPos = item.find_first_of('=');
+			std::string key = item.substr(0, eqPos);
+			if (key.empty()) {
+				throw std::invalid_argument("Colony argument without name: " + item);
+			}
+			if (values.count(key) == 0) {
+				order.push_back(key);
+			}
+			values[key] = eqPos == std::string::npos ? "" : item.substr(eqPos + 1);
+		}
+	}
+
+	const std::vector<std::string>& keys() const {
+		return order;
+	}
+
+	bool has(const std::string& key) const {
+		return values.count(key) != 0;
+	}
+
+	/*
+	Throws if an argument is neither declared in `declaration` nor in `common_declaration`
+	*/
+	void validate(const std::string& declaration, const std::string& common_declaration = "") const {
+		VariantArgs declared(declaration);
+		VariantArgs common(common_declaration);
+		for (const std::string& key : order) {
+			if (!declared.has(key) && !common.has(key)) {
+				throw std::invalid_argument("Unknown colony argument: " + key);
+			}
+		}
+	}
+
+	template<typename T>
+	T get(const std::string& key, T fallback) const {
+		auto it = values.find(key);
+		if (it == values.end()) {
+			return fallback;
+		}
+
+		std::istringstream stream(it->second);
+		T value;
+		stream >> value;
+		// Streams accept "-1" for unsigned types and wrap it around
+		bool negative = std::is_unsigned<T>::value && it->second.find('-') != std::string::npos;
+		if (stream.fail() || !stream.eof() || negative) {
+			throw std::invalid_argument("Invalid value for colony argument " + key + ": \"" + it->second + "\"");
+		}
+		return value;
+	}
+};
+
+/*
+Flags are true when given without a value
+*/
+template<>
+inline bool VariantArgs::get<bool>(const std::string& key, bool fallback) const {
+	auto it = values.find(key);
+	if (it == values.end()) {
+		return fallback;
+	}
+
+	if (it->second.empty() || it->second == "1" || it->second == "true") {
+		return true;
+	}
+	if (it->second == "0" || it->second == "false") {
+		return false;
+	}
+	throw std::invalid_argument("Invalid value for colony flag " + key + ": \"" + it->second + "\"");
+}
+
+template<>
+inline std::string VariantArgs::get<std::string>(const std::string& key, std::string fallback) const {
+	auto it = values.find(key);
+	return it == values.end() ? fallback : it->second;
+}
@@ -0,0 +1,67 @@
+
+/*
+	Device-side best ant selection shared by all variants
+	best_ant[0]: Index of the best ant of the last round
+	best_ant[1]: Route length of the best ant of the last round
+	best_ant[2]: Shortest route length found so far
+	best_ant[3 + 2 * r], best_ant[4 + 2 * r]: Index and route length of the ant ranked r (r < top_k)
+
+	Runs as a single work-group with a power-of-two size.
+	Each rank is a tree reduction over (length, index) pairs ordered lexicographically,
+	skipping every pair up to and including the one selected for the previous rank.
+	Ties go to the lower index, like a serial search would.
+*/
+bool ant_before(int length, int idx, int other_length, int other_idx) {
+	return length < other_length || (length == other_length && idx < other_idx);
+}
+
+void kernel get_best_ant(
+global const int* ant_route_length,
+global int* best_ant,
+local int* reduce_length,
+local int* reduce_idx,
+int ant_count,
+int top_k
+) {
+	const int lid = get_local_id(0);
+	const int worker_size = get_local_size(0);
+
+	int previous_length = INT_MIN;
+	int previous_idx = -1;
+	for (int rank = 0; rank < top_k; rank++) {
+		int own_length = INT_MAX;
+		int own_idx = ant_count;
+		for (int i = lid; i < ant_count; i += worker_size) {
+			int length = ant_route_length[i];
+			if (ant_before(previous_length, previous_idx, length, i) && ant_before(length, i, own_length, own_idx)) {
+				own_length = length;
+				own_idx = i;
+			}
+		}
+		reduce_length[lid] = own_length;
+		reduce_idx[lid] = own_idx;
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		for (int stride = worker_size / 2; stride > 0; stride /= 2) {
+			if (lid < stride && ant_before(reduce_length[lid + stride], reduce_idx[lid + stride], reduce_length[lid], reduce_idx[lid])) {
+				reduce_length[lid] = reduce_length[lid + stride];
+				reduce_idx[lid] = reduce_idx[lid + stride];
+			}
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+
+		previous_length = reduce_length[0];
+		previous_idx = reduce_idx[0];
+		if (lid == 0) {
+			best_ant[3 + 2 * rank] = previous_idx;
+			best_ant[4 + 2 * rank] = previous_length;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (lid == 0) {
+		best_ant[0] = best_ant[3];
+		best_ant[1] = best_ant[4];
+		best_ant[2] = min(best_ant[2], best_ant[4]);
+	}
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
 #include <random>
 
 #include "clcolony.hpp"
@@ -29,14 +30,15 @@ protected:
 		cl_double, // min_pheromone
 		cl_double, // max_pheromone
 		cl::Buffer, // ant_routes
-		cl_uint, // best_ant_idx
-		cl_double, // best_ant_pheromone
+		cl::Buffer, // best_ant
+		cl_double, // q
 		cl_int  // problem_size
 	> updatePheromoneCL;
 
 	cl::KernelFunctor<
 		cl::Buffer, // allowed_template
-		cl::Buffer // allowed_data
+		cl::Buffer, // allowed_data
+		cl_int      // problem_size
 	> resetAllowedCL;
 
 	cl::Buffer pheromone_d;
@@ -50,10 +52,10 @@ protected:
 	cl::Buffer rng_seeds_d;
 	cl::Buffer probabilities_d;
 
-	void advanceAnts() {
-		cl::NDRange global_size(problem.size());
-		advanceAntsCL(
-			cl::EnqueueArgs(queue, global_size),
+	StageEvents advanceAnts(const StageEvents& wait_for) {
+		cl::NDRange global_size(ant_count);
+		return { advanceAntsCL(
+			cl::EnqueueArgs(queue, wait_for, global_size),
 			probabilities_d,
 			weights_d,
 			routes_d,
@@ -62,13 +64,13 @@ protected:
 			ant_allowed_d,
 			problem.size(),
 			rng_seeds_d			
-		).wait();
+		) };
 	}
 
-	void updatePheromone(uint best_ant, double spread) {
+	StageEvents updatePheromone(const StageEvents& wait_for, double q) {
 		cl::NDRange global_size(problem.size() * problem.size());
-		updatePheromoneCL(
-			cl::EnqueueArgs(queue, global_size),
+		return { updatePheromoneCL(
+			cl::EnqueueArgs(queue, wait_for, global_size),
 			pheromone_d,
 			probabilities_d,
 			visibility_d,
@@ -77,19 +79,20 @@ protected:
 			params.min_pheromone,
 			params.max_pheromone,
 			routes_d,
-			best_ant,
-			spread,
+			best_ant_d,
+			q,
 			problem.size()
-		).wait();
+		) };
 	}
 
-	void resetAllowed() {
-		cl::NDRange global_size(problem.size() * problem.size());
-		resetAllowedCL(
-			cl::EnqueueArgs(queue, global_size),
+	StageEvents resetAllowed(const StageEvents& wait_for) {
+		cl::NDRange global_size(ant_count * problem.size());
+		return { resetAllowedCL(
+			cl::EnqueueArgs(queue, wait_for, global_size),
 			ant_allowed_template_d,
-			ant_allowed_d
-		).wait();
+			ant_allowed_d,
+			problem.size()
+		) };
 	}
 
 public:
@@ -105,62 +108,61 @@ public:
 
 	Graph<double> pheromone;
 
+	/*
+	The prefix sums are written in the same pass that reads the probabilities row,
+	the binary search rereads only log2(n) of them.
+	Releasing the dependencies scans a column of the weights and the allowed counters
+	*/
+	RoundCost roundCost() const override {
+		RoundCost cost = CLColonyOptimizer::roundCost();
+		const double n = problem.size();
+		const double steps = ant_count * (n - 1);
+		cost.advance.bytes = steps * (n * (sizeof(double) + sizeof(int) + sizeof(double) + sizeof(int) + sizeof(int)) + std::log2(n) * sizeof(double));
+		cost.advance.flops = steps * n;
+		return cost;
+	}
+
 	void prepare() override {
 		setupCL(false);
-		program = loadProgramVariant(static_name);
+		program = loadProgramVariant(static_name, specializationArgs());
 
-		pheromone_d = createAndFillBuffer(problem.sizeSqr(), false, pheromone);
-		weights_d = createAndFillBuffer(problem.sizeSqr(), true, problem.weights);
-		routes_d = createAndFillBuffer<int>(problem.sizeSqr(), false, 0);
-		routes_length_d = createAndFillBuffer(problem.size(), false, std::numeric_limits<cl_int>::max());
-		ant_sample_d = createAndFillBuffer<double>(problem.sizeSqr(), false, 0.0);
-		ant_allowed_d = createBuffer<int>(problem.sizeSqr(), false);
-		probabilities_d = createAndFillBuffer<double>(problem.sizeSqr(), false, 0.0);
+		pheromone_d = createAndFillBuffer("pheromone", problem.sizeSqr(), false, pheromone);
+		weights_d = wrapHostBuffer("weights", problem.weights);
+		routes_d = createAndFillBuffer<int>("routes", ant_count * problem.size(), false, 0);
+		routes_length_d = createAndFillBuffer("routes_length", ant_count, false, std::numeric_limits<cl_int>::max());
+		ant_sample_d = createAndFillBuffer<double>("ant_sample", ant_count * problem.size(), false, 0.0);
+		ant_allowed_d = createBuffer<int>("ant_allowed", ant_count * problem.size(), false);
+		probabilities_d = createAndFillBuffer<double>("probabilities", problem.sizeSqr(), false, 0.0);
 
-		Graph<double> visibility = getVisibility();
-		visibility_d = createAndFillBuffer(problem.sizeSqr(), true, visibility);
+		visibility_d = createVisibilityBuffer();
 
-		Graph<int> allowed_data = getAllowedData();
-		ant_allowed_template_d = createAndFillBuffer(problem.sizeSqr(), true, allowed_data);
+		std::vector<int> allowed_template = getAllowedList();
+		ant_allowed_template_d = createAndFillBuffer("ant_allowed_template", allowed_template.size(), true, allowed_template);
 
 		std::vector<uint> rngs = getRngs();
-		rng_seeds_d = createAndFillBuffer(problem.size(), false, rngs);
+		rng_seeds_d = createAndFillBuffer("rng_seeds", rngs.size(), false, rngs);
+
+		setupBestAnt();
 		queue.finish();
 
 		advanceAntsCL = decltype(advanceAntsCL)(cl::Kernel(program, "wander_ant"));
 		updatePheromoneCL = decltype(updatePheromoneCL)(cl::Kernel(program, "update_pheromone"));
 		resetAllowedCL = decltype(resetAllowedCL)(cl::Kernel(program, "reset_allowed"));
 		
-		resetAllowed();
-		updatePheromone(0, 0);
+		resetAllowed({});
+		updatePheromone({}, 0);
+		queue.finish();
 	}
 
 	void optimize(unsigned int rounds) override {
-		std::vector<int> ant_route_lengths(problem.size());
-		std::vector<int> ant_route(problem.size());
-		while (rounds-- > 0) {
-			Profiler::start("opts");
-
-			Profiler::start("adva");
-			advanceAnts();
-			Profiler::stop("adva");
-
-			Profiler::start("eval");
-			queue.enqueueReadBuffer(routes_length_d, CL_TRUE, 0, sizeof(int) * ant_route_lengths.size(), ant_route_lengths.data());
-			auto best_ant_it = std::min_element(ant_route_lengths.begin(), ant_route_lengths.end());
-			size_t best_ant_idx = std::distance(ant_route_lengths.begin(), best_ant_it);
-			queue.enqueueReadBuffer(routes_d, CL_TRUE, best_ant_idx * problem.size() * sizeof(int), sizeof(int) * problem.size(), ant_route.data());
-			best_route_length = std::min(*best_ant_it, best_route_length);
-			Profiler::stop("eval");
-			
-			
-			Profiler::start("upda");
-			updatePheromone(best_ant_idx, params.q / *best_ant_it);
-			resetAllowed();
-			Profiler::stop("upda");
-
-			Profiler::stop("opts");
-		}
+		runPipeline(rounds, routes_length_d,
+			[this](const StageEvents& wait_for) { return advanceAnts(wait_for); },
+			[this](const StageEvents& wait_for) {
+				StageEvents events = updatePheromone(wait_for, params.q);
+				StageEvents reset = resetAllowed(events);
+				events.insert(events.end(), reset.begin(), reset.end());
+				return events;
+			});
 	}
 };
 
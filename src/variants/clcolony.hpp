@@ -1,10 +1,16 @@
 #pragma once
 
 #include <CL/opencl.hpp>
+#include <array>
 #include <iostream>
 #include <cassert>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 
 #include "../optimizer.hpp"
+#include "../profiler.hpp"
+#include "kernel_sources.hpp"
 
 class CLColonyOptimizer: public AntOptimizer {
 protected:
@@ -26,9 +32,7 @@ protected:
 		std::vector<cl::Platform> all_platforms;
 		cl::Platform::get(&all_platforms);
 		if (all_platforms.empty()) {
-			std::cerr
-				<< "[OpenCL] No platforms found" << std::endl;
-			exit(EXIT_FAILURE);
+			throw std::runtime_error("[OpenCL] No platforms found");
 		}
 		cl::Platform default_platform = all_platforms.at(0);
 		if (verbose) {
@@ -40,8 +44,7 @@ protected:
 		std::vector<cl::Device> devices;
 		default_platform.getDevices(CL_DEVICE_TYPE_GPU, &devices);
 		if (devices.empty()) {
-			std::cerr << "[OpenCL] No devices found." << std::endl;
-			exit(EXIT_FAILURE);
+			throw std::runtime_error("[OpenCL] No devices found.");
 		}
 
 		device = devices.at(0);
@@ -52,51 +55,164 @@ protected:
 		}
 
 		context = cl::Context(device);
-		queue = cl::CommandQueue(context, device);
+		queue = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE);
+
+		unifiedMemory = device.getInfo<CL_DEVICE_HOST_UNIFIED_MEMORY>() == CL_TRUE;
+		readMemoryLimits({ device });
+		if (verbose && unifiedMemory) {
+			std::cout << "[OpenCL] Device shares memory with the host, using host-visible buffers\n";
+		}
+
+		if (Profiler::is_tracing() || convergence.enabled) {
+			deviceClockOffset = measureDeviceClockOffset(queue);
+		}
 	}
 
-	cl::Program loadBinaryProgram(std::filesystem::path path, std::string compiler_args) {
-		std::vector<char> program_binary = loadFileBinary(path);
+	/*
+	The host reads its clock right after a marker completed, so host minus device time
+	is never below the real offset. The smallest difference of a few markers is kept.
+	*/
+	static Profiler::Duration measureDeviceClockOffset(cl::CommandQueue& on_queue) {
+		Profiler::Duration offset = Profiler::Duration::max();
+		for (int i = 0; i < 8; i++) {
+			cl::Event marker;
+			on_queue.enqueueMarkerWithWaitList(nullptr, &marker);
+			marker.wait();
+			Profiler::Duration host = Profiler::Clock::now().time_since_epoch();
+			cl_ulong end = marker.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+			offset = std::min(offset, host - std::chrono::duration_cast<Profiler::Duration>(std::chrono::nanoseconds(end)));
+		}
+		return offset;
+	}
+
+	Profiler::Timepoint hostTime(cl_ulong device_time) const {
+		return Profiler::Timepoint(std::chrono::duration_cast<Profiler::Duration>(std::chrono::nanoseconds(device_time)) + deviceClockOffset);
+	}
+
+	/*
+	Hands the commands of a stage to the trace, numbered by submission if there are several
+	@param queue_track : Trace track of the queue the stage ran on
+	*/
+	void traceStage(const std::string& name, const std::vector<cl::Event>& events, uint32_t queue_track) {
+		if (!Profiler::is_tracing()) {
+			return;
+		}
+		for (size_t i = 0; i < events.size(); i++) {
+			Profiler::record_device({
+				events.size() == 1 ? name : name + "[" + std::to_string(i) + "]",
+				queue_track,
+				hostTime(events[i].getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>()),
+				hostTime(events[i].getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>()),
+				hostTime(events[i].getProfilingInfo<CL_PROFILING_COMMAND_START>()),
+				hostTime(events[i].getProfilingInfo<CL_PROFILING_COMMAND_END>())
+			});
+		}
+	}
+
+	cl::Program buildBinaryProgram(const std::string& name, const std::vector<char>& program_binary, std::string compiler_args) {
 		cl::Program program(context, program_binary);
 
 		cl_int succ = program.build(compiler_args);
 		if (succ != CL_SUCCESS) {
-			std::cerr
-				<< "[OpenCL] Error creating program " << path.filename() << ": "
-				<< "(" << succ << ")"
-				<< "\n";
-			exit(EXIT_FAILURE);
+			throw std::runtime_error("[OpenCL] Error creating program " + name + ": (" + std::to_string(succ) + ")");
 		}
 
 		succ = program.build();
 		if (succ != CL_SUCCESS) {
-			std::cerr
-				<< "[OpenCL] Error building program " << path.filename() << ": "
-				<< "(" << succ << ") "
-				<< program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << "\n";
-			exit(EXIT_FAILURE);
+			throw std::runtime_error("[OpenCL] Error building program " + name + ": "
+				+ "(" + std::to_string(succ) + ") " + program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device));
 		}
 		return program;		
 	}
 
-	cl::Program loadTextProgram(std::filesystem::path path, std::string compiler_args) {
-		std::string program_source = loadFileString(path);
-		cl::Program program(context, program_source);
-		std::filesystem::path location = path;
-		location.remove_filename();
+	/*
+	Compiled programs are cached per (source, compiler arguments, device, driver).
+	Returns an empty path if caching is disabled.
+	*/
+	std::filesystem::path programCachePath(const std::string& name, const std::string& program_source, const std::string& compiler_args) {
+		if (params.kernel_cache_directory.empty()) {
+			return std::filesystem::path();
+		}
 
-		cl_int succ = program.build("-I \"" + location.string() + "\" " + compiler_args);
+		std::string key = program_source + '\0'
+			+ compiler_args + '\0'
+			+ device.getInfo<CL_DEVICE_NAME>() + '\0'
+			+ device.getInfo<CL_DEVICE_VERSION>() + '\0'
+			+ device.getInfo<CL_DRIVER_VERSION>();
+		std::stringstream file_name;
+		file_name << name << "-" << std::hex << std::hash<std::string>{}(key) << ".bin";
+		return std::filesystem::path(params.kernel_cache_directory) / file_name.str();
+	}
+
+	bool loadCachedProgram(const std::filesystem::path& cache_file, std::string compiler_args, cl::Program& program) {
+		if (cache_file.empty() || !std::filesystem::exists(cache_file)) {
+			return false;
+		}
+
+		std::vector<char> binary = loadFileBinary(cache_file);
+		cl::Program::Binaries binaries { std::vector<unsigned char>(binary.begin(), binary.end()) };
+		cl_int succ = CL_SUCCESS;
+		program = cl::Program(context, { device }, binaries, nullptr, &succ);
+		return succ == CL_SUCCESS && program.build(compiler_args) == CL_SUCCESS;
+	}
+
+	void storeCachedProgram(const std::filesystem::path& cache_file, const cl::Program& program) {
+		if (cache_file.empty()) {
+			return;
+		}
+
+		cl::Program::Binaries binaries = program.getInfo<CL_PROGRAM_BINARIES>();
+		if (binaries.empty() || binaries.front().empty()) {
+			return;
+		}
+
+		// Write to a temporary file first, so concurrent runs never read a partial binary
+		std::error_code error;
+		std::filesystem::create_directories(cache_file.parent_path(), error);
+		std::filesystem::path temp_file = cache_file;
+		temp_file += ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+		{
+			std::ofstream file(temp_file, std::ios::binary);
+			file.write(reinterpret_cast<const char*>(binaries.front().data()), binaries.front().size());
+			if (!file) {
+				return;
+			}
+		}
+		std::filesystem::rename(temp_file, cache_file, error);
+	}
+
+	cl::Program buildTextProgram(const std::string& name, const std::string& program_source, std::string compiler_args) {
+		cl::Program program;
+		std::filesystem::path cache_file = programCachePath(name, program_source, compiler_args);
+		if (loadCachedProgram(cache_file, compiler_args, program)) {
+			return program;
+		}
+
+		program = cl::Program(context, program_source);
+
+		cl_int succ = program.build(compiler_args);
 		if (succ != CL_SUCCESS) {
-			std::cerr
-				<< "[OpenCL] Error building program " << path.filename() << ": "
-				<< "(" << succ << ") "
-				<< program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << "\n";
-			exit(EXIT_FAILURE);
+			throw std::runtime_error("[OpenCL] Error building program " + name + ": "
+				+ "(" + std::to_string(succ) + ") " + program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device));
 		}
-		
+
+		storeCachedProgram(cache_file, program);
 		return program;
 	}
 
+	cl::Program loadBinaryProgram(std::filesystem::path path, std::string compiler_args) {
+		return buildBinaryProgram(path.filename().string(), loadFileBinary(path), compiler_args);
+	}
+
+	cl::Program loadTextProgram(std::filesystem::path path, std::string compiler_args) {
+		std::filesystem::path location = path;
+		location.remove_filename();
+		return buildTextProgram(
+			path.filename().string(),
+			loadFileString(path),
+			"-I \"" + location.string() + "\" " + compiler_args);
+	}
+
 	bool is_spirv_file(std::filesystem::path path) {
 		std::ifstream file(path, std::ios::binary);
 		union {
@@ -116,12 +232,28 @@ protected:
 		}
 	}
 
+	/*
+	Uses the kernel embedded at build time unless `params.kernel_directory` is set,
+	in which case `<kernel_directory>/<variant_name>.cl` is loaded from disk instead.
+	*/
 	cl::Program loadProgramVariant(const char* variant_name, std::string compiler_args = "") {
-		return loadProgram(
-			std::filesystem::path("./src/variants") /
-			std::filesystem::path(variant_name).replace_extension(".cl"),
-			compiler_args
-		);
+		const EmbeddedKernel* kernel = findEmbeddedKernel(variant_name);
+		if (!params.kernel_directory.empty() || kernel == nullptr) {
+			std::filesystem::path directory = params.kernel_directory.empty() ? "./src/variants" : params.kernel_directory;
+			return loadProgram(
+				directory /
+				std::filesystem::path(variant_name).replace_extension(".cl"),
+				compiler_args
+			);
+		}
+
+		if (kernel->spirv_size > 0) {
+			return buildBinaryProgram(
+				variant_name,
+				std::vector<char>(kernel->spirv, kernel->spirv + kernel->spirv_size),
+				compiler_args);
+		}
+		return buildTextProgram(variant_name, kernel->source, compiler_args);
 	}
 
 	template<typename T>
@@ -129,22 +261,75 @@ protected:
 		return cl::Local(sizeof(T) * size);
 	}
 
+	cl_mem_flags bufferFlags(bool read_only) {
+		cl_mem_flags flags = read_only ? CL_MEM_READ_ONLY : CL_MEM_READ_WRITE;
+		return unifiedMemory ? flags | CL_MEM_ALLOC_HOST_PTR : flags;
+	}
+
+	/*
+	Sets the limits allocateBuffer checks against, the smallest single allocation and the summed memory of `devices`.
+	Sub-devices report the memory of the device they were split from, which counts once.
+	*/
+	void readMemoryLimits(const std::vector<cl::Device>& devices) {
+		maxAllocationBytes = std::numeric_limits<size_t>::max();
+		device_memory.capacity = 0;
+		std::vector<cl_device_id> roots;
+		for (const cl::Device& limited : devices) {
+			maxAllocationBytes = std::min<size_t>(maxAllocationBytes, limited.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>());
+
+			cl::Device root = limited;
+			for (cl_device_id parent = root.getInfo<CL_DEVICE_PARENT_DEVICE>(); parent != nullptr; parent = root.getInfo<CL_DEVICE_PARENT_DEVICE>()) {
+				root = cl::Device(parent, true);
+			}
+			if (std::find(roots.begin(), roots.end(), root()) == roots.end()) {
+				roots.push_back(root());
+				device_memory.capacity += root.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+			}
+		}
+	}
+
+	/*
+	Accounts the buffer to `name` in device_memory. Allocations the device cannot hold are refused
+	before the runtime fails on them, or on the first kernel using them.
+	*/
+	cl::Buffer allocateBuffer(const std::string& name, cl_mem_flags flags, size_t bytes, void* host_ptr = nullptr) {
+		if (bytes > maxAllocationBytes || (device_memory.capacity > 0 && device_memory.total + bytes > device_memory.capacity)) {
+			std::ostringstream message;
+			message
+				<< "[OpenCL] Buffer " << name << " of " << MemoryAccount::mebibytes(bytes) << " MiB does not fit: "
+				<< MemoryAccount::mebibytes(device_memory.total) << " MiB already allocated, "
+				<< MemoryAccount::mebibytes(device_memory.capacity) << " MiB global memory, "
+				<< MemoryAccount::mebibytes(maxAllocationBytes) << " MiB per allocation\n";
+			for (const auto& [allocated, allocated_bytes] : device_memory.allocations) {
+				message << "  " << allocated << ": " << MemoryAccount::mebibytes(allocated_bytes) << " MiB\n";
+			}
+			message << "Fewer ants (ants=<count>) shrink the per-ant buffers";
+			throw std::runtime_error(message.str());
+		}
+		device_memory.add(name, bytes);
+		return cl::Buffer(context, flags, bytes, host_ptr);
+	}
+
 	template<typename T>
-	cl::Buffer createBuffer(size_t size, bool read_only) {
-		return cl::Buffer(context, read_only ? CL_MEM_READ_ONLY : CL_MEM_READ_WRITE, sizeof(T) * size);	
+	cl::Buffer createBuffer(const std::string& name, size_t size, bool read_only) {
+		return allocateBuffer(name, bufferFlags(read_only), sizeof(T) * size);
 	}
 
 	template<typename T>
-	cl::Buffer createAndFillBuffer(size_t size, bool read_only, T content) {
-		cl::Buffer result = createBuffer<T>(size, read_only);
+	cl::Buffer createAndFillBuffer(const std::string& name, size_t size, bool read_only, T content) {
+		cl::Buffer result = createBuffer<T>(name, size, read_only);
 		queue.enqueueFillBuffer(result, content, 0, sizeof(T) * size);
 		return result;
 	}
 
 	template<typename T>
-	cl::Buffer createAndFillBuffer(size_t size, bool read_only, const std::vector<T>& data) {
+	cl::Buffer createAndFillBuffer(const std::string& name, size_t size, bool read_only, const std::vector<T>& data) {
 		assert(size == data.size());
-		cl::Buffer result = createBuffer<T>(size, read_only);
+		if (unifiedMemory) {
+			// Filled on allocation, without staging the data through the queue
+			return allocateBuffer(name, bufferFlags(read_only) | CL_MEM_COPY_HOST_PTR, sizeof(T) * size, const_cast<T*>(data.data()));
+		}
+		cl::Buffer result = createBuffer<T>(name, size, read_only);
 		queue.enqueueWriteBuffer(
 			result,
 			CL_FALSE,
@@ -155,8 +340,291 @@ protected:
 	}
 	
 	template<typename T>
-	cl::Buffer createAndFillBuffer(size_t size, bool read_only, const Graph<T>& data) {
-		return createAndFillBuffer(size, read_only, data.adjacency_matrix.data);
+	cl::Buffer createAndFillBuffer(const std::string& name, size_t size, bool read_only, const Graph<T>& data) {
+		return createAndFillBuffer(name, size, read_only, data.adjacency_matrix.data);
+	}
+
+	/*
+	Read-only buffer over host data that outlives the optimizer's buffers, e.g. the problem matrices.
+	With unified memory the device reads `data` in place (zero-copy),
+	runtimes may still copy if `data` is not aligned to their liking.
+	*/
+	template<typename T>
+	cl::Buffer wrapHostBuffer(const std::string& name, const std::vector<T>& data) {
+		if (!unifiedMemory) {
+			return createAndFillBuffer(name, data.size(), true, data);
+		}
+		return allocateBuffer(name, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, sizeof(T) * data.size(), const_cast<T*>(data.data()));
+	}
+
+	template<typename T>
+	cl::Buffer wrapHostBuffer(const std::string& name, const Graph<T>& data) {
+		return wrapHostBuffer(name, data.adjacency_matrix.data);
+	}
+
+	/*
+	Blocking read of `count` elements, mapped instead of copied through the queue with unified memory
+	*/
+	template<typename T>
+	void readBuffer(cl::CommandQueue& on_queue, const cl::Buffer& buffer, size_t offset, size_t count, T* result) {
+		if (!unifiedMemory) {
+			on_queue.enqueueReadBuffer(buffer, CL_TRUE, sizeof(T) * offset, sizeof(T) * count, result);
+			return;
+		}
+		const T* mapped = static_cast<const T*>(on_queue.enqueueMapBuffer(buffer, CL_TRUE, CL_MAP_READ, sizeof(T) * offset, sizeof(T) * count));
+		std::copy_n(mapped, count, result);
+		on_queue.enqueueUnmapMemObject(buffer, const_cast<T*>(mapped));
+	}
+
+	template<typename T>
+	void readBuffer(const cl::Buffer& buffer, size_t offset, size_t count, T* result) {
+		readBuffer(queue, buffer, offset, count, result);
+	}
+
+	// Round pipeline
+
+	/*
+	Events of all kernels enqueued by a stage, in order of submission
+	*/
+	using StageEvents = std::vector<cl::Event>;
+
+	struct RoundEvents {
+		StageEvents advance;
+		StageEvents evaluate;
+		StageEvents update;
+		// Update of the round before, only set if rounds overlap; the round takes from its end to the end of `update`
+		StageEvents previous_update;
+	};
+
+	cl::Program best_ant_program;
+	cl::KernelFunctor<
+		cl::Buffer, // ant_route_length
+		cl::Buffer, // best_ant
+		cl::LocalSpaceArg, // reduce_length
+		cl::LocalSpaceArg, // reduce_idx
+		cl_int, // ant_count
+		cl_int  // top_k
+	> getBestAntCL { cl::Kernel() };
+
+	/*
+	best_ant_d[0]: Index of the best ant of the last round
+	best_ant_d[1]: Route length of the best ant of the last round
+	best_ant_d[2]: Shortest route length found so far
+	best_ant_d[3 + 2 * r], best_ant_d[4 + 2 * r]: Index and route length of the ant ranked r of the last round
+	*/
+	cl::Buffer best_ant_d;
+	size_t best_ant_work_size = 0;
+	cl::LocalSpaceArg best_ant_length_d;
+	cl::LocalSpaceArg best_ant_idx_d;
+
+	/*
+	Iteration-best and shortest route length so far of every round since the last checkpoint,
+	copied out of best_ant_d[1], best_ant_d[2] on the device so logging convergence needs no synchronization per round.
+	Only allocated while logging convergence.
+	*/
+	cl::Buffer convergence_d;
+
+	/*
+	How many of the best ants of a round are ranked into `best_ant_d`, e.g. for rank-based or elitist deposits
+	*/
+	unsigned int best_ant_top_k = 1;
+
+	/*
+	Rounds between two host synchronizations of the round pipeline
+	*/
+	unsigned int checkpoint_interval = 64;
+
+	/*
+	Second queue on `device`, the overlapped pipeline evaluates and updates on it
+	while `queue` already constructs the next round
+	*/
+	cl::CommandQueue update_queue;
+
+	/*
+	@param top_k : How many of the best ants to rank, at most one per ant
+	*/
+	void setupBestAnt(unsigned int top_k = 1) {
+		best_ant_program = loadProgramVariant("best_ant", specializationArgs());
+		getBestAntCL = decltype(getBestAntCL)(cl::Kernel(best_ant_program, "get_best_ant"));
+
+		// One work-group, the largest power of two not exceeding the ant count or the device limit
+		size_t max_work_size = getBestAntCL.getKernel().getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+		best_ant_work_size = 1;
+		while (best_ant_work_size * 2 <= std::min(ant_count, max_work_size)) {
+			best_ant_work_size *= 2;
+		}
+		best_ant_length_d = createLocalBuffer<cl_int>(best_ant_work_size);
+		best_ant_idx_d = createLocalBuffer<cl_int>(best_ant_work_size);
+
+		best_ant_top_k = std::clamp<unsigned int>(top_k, 1, ant_count);
+		std::vector<cl_int> best_ant(3 + 2 * best_ant_top_k, std::numeric_limits<cl_int>::max());
+		best_ant[0] = 0;
+		best_ant_d = createAndFillBuffer("best_ant", best_ant.size(), false, best_ant);
+		setupConvergence();
+	}
+
+	void setupConvergence() {
+		if (convergence.enabled) {
+			convergence_d = createBuffer<cl_int>("convergence", 2 * checkpoint_interval, false);
+		}
+	}
+
+	/*
+	Copies the route lengths of the round evaluated by `evaluate` into `slot` of convergence_d.
+	The copy joins `evaluate`, so whatever waits for the stage also waits for it.
+	*/
+	void logIterationBest(cl::CommandQueue& on_queue, size_t slot, StageEvents& evaluate) {
+		if (!convergence.enabled) {
+			return;
+		}
+		cl::Event copied;
+		StageEvents wait_for = { evaluate.back() };
+		on_queue.enqueueCopyBuffer(best_ant_d, convergence_d, sizeof(cl_int), 2 * sizeof(cl_int) * slot, 2 * sizeof(cl_int), &wait_for, &copied);
+		evaluate.push_back(copied);
+	}
+
+	/*
+	Adds the logged rounds to the convergence log, each finishing with the last command in `round_end`
+	*/
+	void readConvergence(cl::CommandQueue& on_queue, const std::vector<cl::Event>& round_end, const std::vector<unsigned int>& round_count) {
+		if (!convergence.enabled) {
+			return;
+		}
+		std::vector<cl_int> lengths(2 * round_end.size());
+		readBuffer(on_queue, convergence_d, 0, lengths.size(), lengths.data());
+		for (size_t i = 0; i < round_end.size(); i++) {
+			convergence.add(lengths[2 * i], lengths[2 * i + 1],
+				hostTime(round_end[i].getProfilingInfo<CL_PROFILING_COMMAND_END>()), round_count[i]);
+		}
+	}
+
+	StageEvents getBestAnt(const cl::Buffer& route_length, const StageEvents& wait_for) {
+		return getBestAnt(queue, route_length, wait_for);
+	}
+
+	StageEvents getBestAnt(cl::CommandQueue& on_queue, const cl::Buffer& route_length, const StageEvents& wait_for) {
+		cl::NDRange global_size(best_ant_work_size);
+		cl::NDRange local_size(best_ant_work_size);
+		return { getBestAntCL(
+			cl::EnqueueArgs(on_queue, wait_for, global_size, local_size),
+			route_length,
+			best_ant_d,
+			best_ant_length_d,
+			best_ant_idx_d,
+			ant_count,
+			best_ant_top_k
+		) };
+	}
+
+	static Profiler::Duration eventDuration(const cl::Event& first, const cl::Event& last) {
+		cl_ulong start = first.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+		cl_ulong end = last.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+		return std::chrono::duration_cast<Profiler::Duration>(std::chrono::nanoseconds(end - start));
+	}
+
+	/*
+	Time between the ends of two commands, e.g. the period of overlapping rounds
+	*/
+	static Profiler::Duration eventGap(const cl::Event& first, const cl::Event& last) {
+		cl_ulong start = first.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+		cl_ulong end = last.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+		return std::chrono::duration_cast<Profiler::Duration>(std::chrono::nanoseconds(end - start));
+	}
+
+	/*
+	Waits for all pending rounds, hands their kernel times to the profiler
+	and reads back the shortest route length found so far.
+	@param best_ant_queue : Queue the best ant is selected on
+	*/
+	void checkpoint(std::vector<RoundEvents>& pending, cl::CommandQueue& best_ant_queue) {
+		cl_int best_ant[3];
+		readBuffer(best_ant_queue, best_ant_d, 0, 3, best_ant);
+		best_route_length = std::min(best_route_length, static_cast<int>(best_ant[2]));
+
+		std::vector<cl::Event> round_end;
+		for (const RoundEvents& round : pending) {
+			round_end.push_back(round.update.back());
+		}
+		readConvergence(best_ant_queue, round_end, std::vector<unsigned int>(pending.size(), 1));
+
+		const uint32_t update_track = &best_ant_queue == &queue ? 0 : 1;
+		for (const RoundEvents& round : pending) {
+			traceStage("adva", round.advance, 0);
+			traceStage("eval", round.evaluate, update_track);
+			traceStage("upda", round.update, update_track);
+			Profiler::record("adva", eventDuration(round.advance.front(), round.advance.back()));
+			Profiler::record("eval", eventDuration(round.evaluate.front(), round.evaluate.back()));
+			Profiler::record("upda", eventDuration(round.update.front(), round.update.back()));
+			Profiler::record("opts", round.previous_update.empty()
+				? eventDuration(round.advance.front(), round.update.back())
+				: eventGap(round.previous_update.back(), round.update.back()));
+		}
+		pending.clear();
+	}
+
+	void checkpoint(std::vector<RoundEvents>& pending) {
+		checkpoint(pending, queue);
+	}
+
+	/*
+	Runs `rounds` rounds of advance -> best ant -> update without blocking the host.
+	Each stage is chained to the previous one through events; the best ant stays in `best_ant_d`.
+	@param route_length : Route lengths written by `advance`
+	@param advance, update : Callables enqueueing the stage after the given events, returning their events
+	*/
+	template<typename Advance, typename Update>
+	void runPipeline(unsigned int rounds, const cl::Buffer& route_length, Advance advance, Update update) {
+		std::vector<RoundEvents> pending;
+		StageEvents previous_round;
+		while (rounds-- > 0) {
+			RoundEvents round;
+			round.advance = advance(previous_round);
+			round.evaluate = getBestAnt(route_length, { round.advance.back() });
+			logIterationBest(queue, pending.size(), round.evaluate);
+			round.update = update(StageEvents { round.evaluate.back() });
+			previous_round = { round.update.back() };
+			pending.push_back(round);
+
+			if (pending.size() >= checkpoint_interval || rounds == 0) {
+				checkpoint(pending);
+			}
+		}
+	}
+
+	/*
+	Like `runPipeline`, but constructs round r + 1 while round r is evaluated and updated on `update_queue`.
+	Round r reads the probabilities of slot r % 2, which the update of round r - 2 wrote,
+	so ants see the pheromone one round later than without overlap.
+	Routes and route lengths are double-buffered the same way.
+	@param route_length : Route lengths written by `advance` per slot
+	@param advance : Callable (slot, events) enqueueing the construction on `queue`
+	@param update : Callable (slot, events) enqueueing the update on `update_queue`, writing the probabilities of `slot`
+	*/
+	template<typename Advance, typename Update>
+	void runOverlappedPipeline(unsigned int rounds, const std::array<cl::Buffer, 2>& route_length, Advance advance, Update update) {
+		update_queue = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE);
+
+		std::vector<RoundEvents> pending;
+		// Updates of the last two rounds, the older one gates the next construction
+		std::array<StageEvents, 2> updates;
+		unsigned int round_idx = 0;
+		while (rounds-- > 0) {
+			const int slot = round_idx % 2;
+			RoundEvents round;
+			round.advance = advance(slot, updates[slot]);
+			round.evaluate = getBestAnt(update_queue, route_length[slot], { round.advance.back() });
+			logIterationBest(update_queue, pending.size(), round.evaluate);
+			round.update = update(slot, StageEvents { round.evaluate.back() });
+			round.previous_update = updates[1 - slot];
+			updates[slot] = { round.update.back() };
+			pending.push_back(round);
+			round_idx++;
+
+			if (pending.size() >= checkpoint_interval || rounds == 0) {
+				checkpoint(pending, update_queue);
+			}
+		}
+		queue.finish();
 	}
 
 	// Commonly used prepare optimizations
@@ -191,17 +659,8 @@ protected:
 		return allowed_prototype;	
 	}
 
-	Graph<int> getAllowedData() {
-		std::vector<int> allowed_prototype = getAllowedList();
-		Graph<int> result(problem.size(), 0);
-		for (auto it = result.adjacency_matrix.data.begin(); it != result.adjacency_matrix.data.end(); std::advance(it, problem.size())) {
-			std::copy(allowed_prototype.begin(), allowed_prototype.end(), it);
-		}	
-		return result;
-	}
-
 	std::vector<uint> getRngs() {
-		std::vector<uint> rngs(problem.size(), 0);
+		std::vector<uint> rngs(ant_count, 0);
 		std::minstd_rand0 rng(params.random_seed);
 		std::generate(rngs.begin(), rngs.end(), rng);
 		return rngs;
@@ -243,12 +702,122 @@ protected:
 		return dep_mask_long;
 	}
 
+	// How to properly check whether device supports int64?
+	// FULL_PROFILE must support int64 i think...
+	bool useLongBitmasks() {
+		return !forceInt32Bitmasks && device.getInfo<CL_DEVICE_PROFILE>() == "FULL_PROFILE";
+	}
+
+	/*
+	The mask is kept in `dependency_mask` / `dependency_mask_long` so the buffer can wrap it
+	*/
+	cl::Buffer createDependencyBuffer(bool swap) {
+		dependency_mask = getDependencyMask(swap);
+		if (useLongBitmasks()) {
+			dependency_mask_long = getLongDependencyMask(dependency_mask);
+			return wrapHostBuffer("dependency_mask", dependency_mask_long);
+		}
+		return wrapHostBuffer("dependency_mask", dependency_mask);
+	}
+
+	/*
+	Visibility^beta, kept in `visibility_host` so the buffer can wrap it
+	*/
+	cl::Buffer createVisibilityBuffer() {
+		visibility_host = getVisibility();
+		return wrapHostBuffer("visibility", visibility_host);
+	}
+
+	/*
+	Compiler arguments specializing a program on the problem, so loop bounds and indices become constants.
+	Kernels fall back to their runtime arguments when compiled without them.
+	@param work_size : Local size of work-group-per-ant kernels, 0 if not applicable
+	*/
+	std::string specializationArgs(size_t work_size = 0) {
+		const size_t bitmask_bits = useLongBitmasks() ? 64 : 32;
+		const size_t bitmask_words = problem.size() / bitmask_bits + (problem.size() % bitmask_bits != 0 ? 1 : 0);
+		std::string args =
+			"-DPROBLEM_SIZE=" + std::to_string(problem.size()) +
+			" -DBITMASK_BITS=" + std::to_string(bitmask_bits) +
+			" -DBITMASK_WORDS=" + std::to_string(bitmask_words);
+		if (work_size > 0) {
+			args += " -DWORK_SIZE=" + std::to_string(work_size);
+		}
+		return args;
+	}
+
+	/*
+	Compiler arguments selecting the subgroup scan of work-group-per-ant kernels if `subgroupScan` is set.
+	Falls back to the Blelloch scan if the device does not report cl_khr_subgroups.
+	*/
+	std::string subgroupScanArgs() {
+		if (!subgroupScan) {
+			return "";
+		}
+
+		if (device.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_subgroups") == std::string::npos) {
+			std::cerr << "[OpenCL] Device does not support cl_khr_subgroups, using work-group scan" << std::endl;
+			return "";
+		}
+
+		// Subgroup built-ins need OpenCL C 2.0 or newer
+		std::string c_version = device.getInfo<CL_DEVICE_OPENCL_C_VERSION>();
+		return c_version.rfind("OpenCL C 3", 0) == 0
+			? " -DSUBGROUP_SCAN -cl-std=CL3.0"
+			: " -DSUBGROUP_SCAN -cl-std=CL2.0";
+	}
+
 	cl::Device device;
 	cl::Context context;
 	cl::CommandQueue queue;
+
+	/*
+	Set by setupCL if the device shares memory with the host, as CPU and integrated GPU runtimes do.
+	Buffers then live in host-visible memory, are filled on allocation and read back by mapping.
+	*/
+	bool unifiedMemory = false;
+
+	// Largest single allocation the device allows, set by setupCL
+	size_t maxAllocationBytes = std::numeric_limits<size_t>::max();
+
+	/*
+	Host clock minus device clock, set by setupCL while tracing
+	*/
+	Profiler::Duration deviceClockOffset = Profiler::Duration::zero();
+
+	// Host copies wrapped by zero-copy buffers, must live as long as the buffers
+	Graph<double> visibility_host;
+	std::vector<cl_uint> dependency_mask;
+	std::vector<cl_ulong> dependency_mask_long;
 public:
 	static constexpr const char* static_name = "opencl";
 	static constexpr const char* static_params = "";
 
+	bool forceInt32Bitmasks = false;
+	bool subgroupScan = false;
+
 	using AntOptimizer::AntOptimizer;
+
+	/*
+	Device memory bandwidth from timing a buffer-to-buffer copy, the read and the write both count.
+	The probe buffers are not accounted in device_memory, they only live during the probe.
+	*/
+	double measureBandwidth() override {
+		size_t bytes = std::min<size_t>(size_t(64) << 20, maxAllocationBytes) / sizeof(cl_int) * sizeof(cl_int);
+		cl::Buffer source(context, CL_MEM_READ_WRITE, bytes);
+		cl::Buffer target(context, CL_MEM_READ_WRITE, bytes);
+		queue.enqueueFillBuffer(source, cl_int(0), 0, bytes);
+
+		double best = 0.0;
+		for (int r = 0; r < 5; r++) {
+			cl::Event copied;
+			queue.enqueueCopyBuffer(source, target, 0, 0, bytes, nullptr, &copied);
+			copied.wait();
+			double seconds = std::chrono::duration<double>(eventDuration(copied, copied)).count();
+			if (seconds > 0.0) {
+				best = std::max(best, 2.0 * bytes / seconds);
+			}
+		}
+		return best;
+	}
 };
\ No newline at end of file
@@ -1,27 +1,39 @@
 
 uint rng_minstd_rand0(uint* state) {
 	const uint a = 16807;
-	const uint c = 0;
 	const uint m = 2147483647;
+	// Schrage's decomposition m = a * q + r keeps a * state % m within 32 bits
+	const uint q = 127773;
+	const uint r = 2836;
 
-	*state = (a * (*state) + c) % m;
+	uint a_lo = a * (*state % q);
+	uint r_hi = r * (*state / q);
+	*state = a_lo >= r_hi ? a_lo - r_hi : a_lo + (m - r_hi);
 
 	return *state;
 }
 
 double rng_range(uint* state, double max) {
 	uint r = rng_minstd_rand0(state);
-	double dr = (double)r / (double)UINT_MAX;
+	double dr = (double)r / 2147483647.0;
 	return dr * max;
 }
 
+// BITMASK_BITS is passed by the host to match the layout of the uploaded dependency masks
+#ifndef BITMASK_BITS
 #if defined(__opencl_c_int64) && !defined(FORCE_32BITMASK)
+#define BITMASK_BITS 64
+#else
+#define BITMASK_BITS 32
+#endif
+#endif
+
+#if BITMASK_BITS == 64
 typedef ulong bitmask;
-const uint BITMASK_SIZE = 64;
 #else
 typedef uint bitmask;
-const uint BITMASK_SIZE = 32;
 #endif
+const uint BITMASK_SIZE = BITMASK_BITS;
 
 void kernel wander_ant(
 global const double* probabilities,
@@ -33,13 +45,20 @@ global double* ant_sample,
 global int* ant_allowed,
 int problem_size,
 global uint* rng_seeds) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
 	int ant_idx = get_global_id(0);
 
 	int* ant_route = ant_routes + ant_idx * problem_size;
 	double* sample = ant_sample + ant_idx * problem_size;
 	int* allowed = ant_allowed + ant_idx * problem_size;
 	uint* seed = rng_seeds + ant_idx;
+#ifdef BITMASK_WORDS
+	const int bitmask_size = BITMASK_WORDS;
+#else
 	const int bitmask_size = problem_size / BITMASK_SIZE + (problem_size % BITMASK_SIZE != 0 ? 1 : 0);
+#endif
 
 	int current_node = 0;
 	int* route_length = ant_route_length + ant_idx;
@@ -131,10 +150,15 @@ double one_minus_roh,
 double min_pheromone,
 double max_pheromone,
 global const int* ant_routes,
-uint best_ant_idx,
-double best_ant_pheromone,
+global const int* best_ant,
+double q,
 int problem_size
 ) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	const int best_ant_idx = best_ant[0];
+	const double best_ant_pheromone = q / best_ant[1];
 	int edge = get_global_id(0);
 	int from = edge / problem_size;
 	int to = edge % problem_size;
@@ -182,11 +206,18 @@ int problem_size
 	probabilities[edge] = powr(pheromone[edge], alpha) * visibility[edge];
 }
 
+/*
+	Copies the single template row into the allowed list of every ant
+*/
 void kernel reset_allowed(
 global const int* allowed_template,
-global int* allowed_data
+global int* allowed_data,
+int problem_size
 ) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
 	int id = get_global_id(0);
-	allowed_data[id] = allowed_template[id];
+	allowed_data[id] = allowed_template[id % problem_size];
 }
 
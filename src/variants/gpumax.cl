@@ -1,27 +1,39 @@
 
 uint rng_minstd_rand0(uint* state) {
 	const uint a = 16807;
-	const uint c = 0;
 	const uint m = 2147483647;
+	// Schrage's decomposition m = a * q + r keeps a * state % m within 32 bits
+	const uint q = 127773;
+	const uint r = 2836;
 
-	*state = (a * (*state) + c) % m;
+	uint a_lo = a * (*state % q);
+	uint r_hi = r * (*state / q);
+	*state = a_lo >= r_hi ? a_lo - r_hi : a_lo + (m - r_hi);
 
 	return *state;
 }
 
 double rng_range(uint* state, double max) {
 	uint r = rng_minstd_rand0(state);
-	double dr = (double)r / (double)UINT_MAX;
+	double dr = (double)r / 2147483647.0;
 	return dr * max;
 }
 
+// BITMASK_BITS is passed by the host to match the layout of the uploaded dependency masks
+#ifndef BITMASK_BITS
 #if defined(__opencl_c_int64) && !defined(FORCE_32BITMASK)
+#define BITMASK_BITS 64
+#else
+#define BITMASK_BITS 32
+#endif
+#endif
+
+#if BITMASK_BITS == 64
 typedef ulong bitmask;
-const uint BITMASK_SIZE = 64;
 #else
 typedef uint bitmask;
-const uint BITMASK_SIZE = 32;
 #endif
+const uint BITMASK_SIZE = BITMASK_BITS;
 
 inline void reset_bit(bitmask* mask, uint index) {
 	uint mask_idx = index / BITMASK_SIZE;
@@ -44,6 +56,17 @@ inline bool has_bit(const bitmask* mask, uint index) {
 	return (mask[mask_idx] & (1UL << bit_idx)) != 0;
 }
 
+// SUBGROUP_SCAN is passed by the host to scan with subgroup collectives instead of the work-group wide Blelloch scan
+#if defined(SUBGROUP_SCAN) && defined(WORK_SIZE) && (defined(cl_khr_subgroups) || defined(__opencl_c_subgroups))
+#define USE_SUBGROUP_SCAN
+#ifdef cl_khr_subgroups
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#endif
+#endif
+
+#ifdef WORK_SIZE
+__attribute__((reqd_work_group_size(WORK_SIZE, 1, 1)))
+#endif
 void kernel wander_ant(
 global const double* probabilities,
 global const int* weights,
@@ -55,16 +78,27 @@ local int* ant_allowed,
 global const int* ant_allowed_template,
 int problem_size,
 global uint* rng_seeds) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
 	int ant_idx = get_group_id(1);
 	int worker_idx = get_local_id(0);
+#ifdef WORK_SIZE
+	const int worker_size = WORK_SIZE;
+#else
 	int worker_size = get_local_size(0);
+#endif
 	int clipped_idx = min(worker_idx, problem_size - 1);
 
 	int* ant_route = ant_routes + ant_idx * problem_size;
 	double* sample = ant_sample;
 	int* allowed = ant_allowed;
 	uint* seed = rng_seeds + ant_idx;
+#ifdef BITMASK_WORDS
+	const int bitmask_size = BITMASK_WORDS;
+#else
 	const int bitmask_size = problem_size / BITMASK_SIZE + (problem_size % BITMASK_SIZE != 0 ? 1 : 0);
+#endif
 
 	double* worker_sample = sample + worker_idx;
 	int* worker_allowed = allowed + worker_idx;
@@ -76,6 +110,9 @@ global uint* rng_seeds) {
 	local int current_node;
 	local double rng;
 	local int next_node;
+#ifdef USE_SUBGROUP_SCAN
+	local double subgroup_totals[WORK_SIZE];
+#endif
 	if (worker_idx == 0) {
 		current_node = 0;
 		rng = 0.0;
@@ -88,6 +125,29 @@ global uint* rng_seeds) {
 		barrier(CLK_LOCAL_MEM_FENCE);
 		sample[worker_idx] = allowed[clipped_idx] == 0 ? probabilities[current_node * problem_size + clipped_idx] : 0;
 
+#ifdef USE_SUBGROUP_SCAN
+		// Inclusive scan within each subgroup, then add the totals of all preceding subgroups
+		double subgroup_scan = sub_group_scan_inclusive_add(sample[worker_idx]);
+		if (get_sub_group_local_id() == get_sub_group_size() - 1) {
+			subgroup_totals[get_sub_group_id()] = subgroup_scan;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (get_sub_group_id() == 0) {
+			const uint subgroup_count = get_num_sub_groups();
+			double carry = 0.0;
+			for (uint base = 0; base < subgroup_count; base += get_sub_group_size()) {
+				uint total_idx = base + get_sub_group_local_id();
+				double total = total_idx < subgroup_count ? subgroup_totals[total_idx] : 0.0;
+				double preceding = sub_group_scan_exclusive_add(total) + carry;
+				if (total_idx < subgroup_count) {
+					subgroup_totals[total_idx] = preceding;
+				}
+				carry += sub_group_reduce_add(total);
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		sample[worker_idx] = subgroup_scan + subgroup_totals[get_sub_group_id()];
+#else
 		// Up-Sweep
 		double my_sample = sample[worker_idx]; // Added at the end
 		for (int i = 0; i < max_pwr; i++) {
@@ -114,6 +174,7 @@ global uint* rng_seeds) {
 		}
 		barrier(CLK_LOCAL_MEM_FENCE);
 		sample[worker_idx] += my_sample; // Make exclusive scan into inclusive one
+#endif
 		
 		if (worker_idx == problem_size - 1) {
 			rng = rng_range(seed, sample[worker_idx]);
@@ -156,9 +217,6 @@ global uint* rng_seeds) {
 	}
 }
 
-global int best_ant_idx = 0;
-global double best_ant_pheromone = 0.0;
-
 void kernel update_pheromone(
 global double* pheromone,
 global double* probabilities,
@@ -168,42 +226,35 @@ double one_minus_roh,
 double min_pheromone,
 double max_pheromone,
 global const int* ant_routes,
-int problem_size
+global const int* best_ant,
+double q,
+int problem_size,
+int top_k
 ) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
 	int edge = get_global_id(0);
 	int from = edge / problem_size;
 	int to = edge % problem_size;
-	const int* best_ant_route = ant_routes + best_ant_idx * problem_size;
 
 	// Evaporate
 	pheromone[edge] *= one_minus_roh;
 
-	// Lay along best_ant
-	if (best_ant_route[from] == to) {
-		pheromone[edge] += best_ant_pheromone;
+	// Rank-based deposit: the ant ranked r lays (top_k - r) times q / length, only the best ant if top_k is 1
+	for (int rank = 0; rank < top_k; rank++) {
+		const int length = best_ant[4 + 2 * rank];
+		if (length == INT_MAX) {
+			// Stuck, as are all ranked below
+			break;
+		}
+		const int* ranked_route = ant_routes + best_ant[3 + 2 * rank] * problem_size;
+		if (ranked_route[from] == to) {
+			pheromone[edge] += (top_k - rank) * q / length;
+		}
 	}
 
 	pheromone[edge] = clamp(pheromone[edge], min_pheromone, max_pheromone);
 
 	probabilities[edge] = powr(pheromone[edge], alpha) * visibility[edge];
 }
-
-void kernel get_best_ant(
-global int* ant_route_length,
-global int* best_length,
-double pheromone,
-int problem_size
-) {
-	int best_len = INT_MAX;
-	int best_idx = -1;
-	for (int i = 0; i < problem_size; i++) {
-		if (best_len > ant_route_length[i]) {
-			best_len = ant_route_length[i];
-			best_idx = i;
-		}
-	}
-
-	best_ant_idx = best_idx;
-	best_ant_pheromone = pheromone / best_len;
-	*best_length = min(*best_length, best_len);
-}
@@ -33,29 +33,28 @@ protected:
 		cl_double, // min_pheromone
 		cl_double, // max_pheromone
 		cl::Buffer, // ant_routes
-		cl_int  // problem_size
+		cl::Buffer, // best_ant
+		cl_double, // q
+		cl_int,  // problem_size
+		cl_int   // top_k
 	> updatePheromoneCL;
 
-	cl::KernelFunctor<
-		cl::Buffer, // ant_route_length
-		cl::Buffer, // best_length
-		cl_double, // pheromone
-		cl_int // problem_size
-	> getBestAntCL;
-
 	cl::Buffer pheromone_d;
 	cl::Buffer visibility_d;
 	cl::Buffer weights_d;
-	cl::Buffer routes_d;
-	cl::Buffer routes_length_d;
+	// Slot 1 is only allocated if rounds overlap, see runOverlappedPipeline
+	std::array<cl::Buffer, 2> routes_d;
+	std::array<cl::Buffer, 2> routes_length_d;
 	cl::LocalSpaceArg ant_sample_d;
 	cl::LocalSpaceArg ant_allowed_d;
 	cl::Buffer ant_allowed_template_d;
 	cl::Buffer rng_seeds_d;
-	cl::Buffer probabilities_d;
+	std::array<cl::Buffer, 2> probabilities_d;
 	cl::Buffer dependencies_d;
 
-	cl::Buffer best_length_d;
+	bool overlapRounds = false;
+	// Ants ranked per round for the rank-based deposit, 1 deposits along the best route only
+	unsigned int top_k = 1;
 
 	size_t work_size = 0;
 
@@ -67,135 +66,124 @@ protected:
 		return i;
 	}
 
-	void advanceAnts() {
-		cl::NDRange global_size(work_size, problem.size());
+	StageEvents advanceAnts(const StageEvents& wait_for, int slot = 0) {
+		cl::NDRange global_size(work_size, ant_count);
 		cl::NDRange local_size(work_size, 1);
-		advanceAntsCL(
-			cl::EnqueueArgs(queue, global_size, local_size),
-			probabilities_d,
+		return { advanceAntsCL(
+			cl::EnqueueArgs(queue, wait_for, global_size, local_size),
+			probabilities_d[slot],
 			weights_d,
 			dependencies_d,
-			routes_d,
-			routes_length_d,
+			routes_d[slot],
+			routes_length_d[slot],
 			ant_sample_d,
 			ant_allowed_d,
 			ant_allowed_template_d,
 			problem.size(),
 			rng_seeds_d			
-		).wait();
+		) };
 	}
 
-	void updatePheromone() {
+	StageEvents updatePheromone(cl::CommandQueue& on_queue, const StageEvents& wait_for, double q, int slot = 0) {
 		cl::NDRange global_size(problem.size() * problem.size());
-		updatePheromoneCL(
-			cl::EnqueueArgs(queue, global_size),
+		return { updatePheromoneCL(
+			cl::EnqueueArgs(on_queue, wait_for, global_size),
 			pheromone_d,
-			probabilities_d,
+			probabilities_d[slot],
 			visibility_d,
 			params.alpha,
 			1 - params.rho,
 			params.min_pheromone,
 			params.max_pheromone,
-			routes_d,
-			problem.size()
-		).wait();
-	}
-
-	void getBestAnt() {
-		cl::NDRange global_size(1);
-		getBestAntCL(
-			cl::EnqueueArgs(queue, global_size),
-			routes_length_d,
-			best_length_d,
-			params.q,
-			problem.size()	
-		).wait();
+			routes_d[slot],
+			best_ant_d,
+			q,
+			problem.size(),
+			best_ant_top_k
+		) };
 	}
 
 public:
 	static constexpr const char* static_name = "gpumax";
-	static constexpr const char* static_params = "";
+	static constexpr const char* static_params = "subgroup,overlap,top_k=<count>";
 
 	GpuMaxOptimizer(Problem problem, AntParams params)
 	:	CLColonyOptimizer::CLColonyOptimizer(problem, params),
 		advanceAntsCL(cl::Kernel()),
 		updatePheromoneCL(cl::Kernel()),
-		getBestAntCL(cl::Kernel()),
-		pheromone(problem.size(), params.initial_pheromone) {}
+		pheromone(problem.size(), params.initial_pheromone) {
+		subgroupScan = params.variant_args.get<bool>("subgroup", false);
+		overlapRounds = params.variant_args.get<bool>("overlap", false);
+		top_k = params.variant_args.get<unsigned int>("top_k", 1);
+		if (top_k == 0) {
+			throw std::invalid_argument("Colony argument top_k must be at least 1");
+		}
+	}
 
 	Graph<double> pheromone;
-	bool forceInt32Bitmasks = false;
+
+	/*
+	Samples and allowed counters stay in local memory, only the probabilities row
+	and the dependency bits of the chosen node go through global memory
+	*/
+	RoundCost roundCost() const override {
+		RoundCost cost = CLColonyOptimizer::roundCost();
+		const double n = problem.size();
+		const double steps = ant_count * (n - 1);
+		cost.advance.bytes = steps * (n * sizeof(double) + n / 8);
+		cost.advance.flops = steps * 2 * n;
+		return cost;
+	}
 
 	void prepare() override {
 		setupCL(false);
-		program = loadProgramVariant(static_name);
-
 		work_size = 1UL << leftmost_one(problem.size() - 1);
-
-		pheromone_d = createAndFillBuffer(problem.sizeSqr(), false, pheromone);
-		weights_d = createAndFillBuffer(problem.sizeSqr(), true, problem.weights);
-		routes_d = createAndFillBuffer<int>(problem.sizeSqr(), false, 0);
-		routes_length_d = createAndFillBuffer(problem.size(), false, std::numeric_limits<cl_int>::max());
-		probabilities_d = createAndFillBuffer<double>(problem.sizeSqr(), false, 0.0);
+		program = loadProgramVariant(static_name, specializationArgs(work_size) + subgroupScanArgs());
+
+		pheromone_d = createAndFillBuffer("pheromone", problem.sizeSqr(), false, pheromone);
+		weights_d = wrapHostBuffer("weights", problem.weights);
+		for (int slot = 0; slot < (overlapRounds ? 2 : 1); slot++) {
+			routes_d[slot] = createAndFillBuffer<int>("routes", ant_count * problem.size(), false, 0);
+			routes_length_d[slot] = createAndFillBuffer("routes_length", ant_count, false, std::numeric_limits<cl_int>::max());
+			probabilities_d[slot] = createAndFillBuffer<double>("probabilities", problem.sizeSqr(), false, 0.0);
+		}
 		ant_sample_d = createLocalBuffer<double>(work_size);
 		ant_allowed_d = createLocalBuffer<int>(problem.size());
-		best_length_d = createAndFillBuffer<cl_int>(1, false, std::numeric_limits<cl_int>::max());
-
-		std::vector<cl_uint> dep_mask = getDependencyMask(false);
 
-		// How to properly check whether device supports int64?
-		// FULL_PROFILE must support int64 i think...
-		if (!forceInt32Bitmasks && device.getInfo<CL_DEVICE_PROFILE>() == "FULL_PROFILE") {
-			std::vector<cl_ulong> dep_mask_long = getLongDependencyMask(dep_mask);
-			dependencies_d = createAndFillBuffer(dep_mask_long.size(), true, dep_mask_long);
-		}
-		else {
-			dependencies_d = createAndFillBuffer(dep_mask.size(), true, dep_mask);
-		}
+		dependencies_d = createDependencyBuffer(false);
 
-		Graph<double> visibility = getVisibility();
-		visibility_d = createAndFillBuffer(problem.sizeSqr(), true, visibility);
+		visibility_d = createVisibilityBuffer();
 
-		Graph<int> allowed_data = getAllowedData();
-		ant_allowed_template_d = createAndFillBuffer(problem.sizeSqr(), true, allowed_data);
+		std::vector<int> allowed_template = getAllowedList();
+		ant_allowed_template_d = createAndFillBuffer("ant_allowed_template", allowed_template.size(), true, allowed_template);
 
 		std::vector<uint> rngs = getRngs();
-		rng_seeds_d = createAndFillBuffer(problem.size(), false, rngs);
+		rng_seeds_d = createAndFillBuffer("rng_seeds", rngs.size(), false, rngs);
 
+		setupBestAnt(top_k);
 		queue.finish();
 
 		advanceAntsCL = decltype(advanceAntsCL)(cl::Kernel(program, "wander_ant"));
 		updatePheromoneCL = decltype(updatePheromoneCL)(cl::Kernel(program, "update_pheromone"));
-		getBestAntCL = decltype(getBestAntCL)(cl::Kernel(program, "get_best_ant"));
 
-		updatePheromone();
+		updatePheromone(queue, {}, 0);
+		if (overlapRounds) {
+			queue.enqueueCopyBuffer(probabilities_d[0], probabilities_d[1], 0, 0, sizeof(cl_double) * problem.sizeSqr());
+		}
+		queue.finish();
 	}
 
 	void optimize(unsigned int rounds) override {
-		std::vector<int> ant_route_lengths(problem.size());
-		std::vector<int> ant_route(problem.size());
-		while (rounds-- > 0) {
-			Profiler::start("opts");
-
-			Profiler::start("adva");
-			advanceAnts();
-			Profiler::stop("adva");
-
-			Profiler::start("eval");
-			getBestAnt();
-			Profiler::stop("eval");
-			
-			
-			Profiler::start("upda");
-			updatePheromone();
-			Profiler::stop("upda");
-
-			Profiler::stop("opts");
+		if (overlapRounds) {
+			runOverlappedPipeline(rounds, routes_length_d,
+				[this](int slot, const StageEvents& wait_for) { return advanceAnts(wait_for, slot); },
+				[this](int slot, const StageEvents& wait_for) { return updatePheromone(update_queue, wait_for, params.q, slot); });
+			return;
 		}
 
-		cl_int best_h;
-		queue.enqueueReadBuffer(best_length_d, CL_TRUE, 0, sizeof(cl_int), &best_h);
-		best_route_length = best_h;
+		runPipeline(rounds, routes_length_d[0],
+			[this](const StageEvents& wait_for) { return advanceAnts(wait_for); },
+			[this](const StageEvents& wait_for) { return updatePheromone(queue, wait_for, params.q); });
 	}
 };
 
@@ -0,0 +1,236 @@
+
+uint rng_minstd_rand0(uint* state) {
+	const uint a = 16807;
+	const uint m = 2147483647;
+	// Schrage's decomposition m = a * q + r keeps a * state % m within 32 bits
+	const uint q = 127773;
+	const uint r = 2836;
+
+	uint a_lo = a * (*state % q);
+	uint r_hi = r * (*state / q);
+	*state = a_lo >= r_hi ? a_lo - r_hi : a_lo + (m - r_hi);
+
+	return *state;
+}
+
+/*
+	PCG-style integer hash, used as a counter-based generator:
+	every candidate of every step gets its own uniform without sharing generator state
+*/
+uint hash_uint(uint x) {
+	uint state = x * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+// Uniform in (0, 1), never 0 or 1 so both logarithms of the Gumbel noise stay finite
+double rng_unit(uint seed, uint step, uint worker) {
+	uint h = hash_uint(seed ^ hash_uint(step ^ hash_uint(worker)));
+	return ((double)h + 0.5) / 4294967296.0;
+}
+
+// BITMASK_BITS is passed by the host to match the layout of the uploaded dependency masks
+#ifndef BITMASK_BITS
+#if defined(__opencl_c_int64) && !defined(FORCE_32BITMASK)
+#define BITMASK_BITS 64
+#else
+#define BITMASK_BITS 32
+#endif
+#endif
+
+#if BITMASK_BITS == 64
+typedef ulong bitmask;
+#else
+typedef uint bitmask;
+#endif
+const uint BITMASK_SIZE = BITMASK_BITS;
+
+inline void reset_bit(bitmask* mask, uint index) {
+	uint mask_idx = index / BITMASK_SIZE;
+	uint bit_idx = index % BITMASK_SIZE;
+
+	mask[mask_idx] &= ~(1UL << bit_idx);
+}
+
+inline void set_bit(bitmask* mask, uint index) {
+	uint mask_idx = index / BITMASK_SIZE;
+	uint bit_idx = index % BITMASK_SIZE;
+
+	mask[mask_idx] |= (1UL << bit_idx);
+}
+
+inline bool has_bit(const bitmask* mask, uint index) {
+	uint mask_idx = index / BITMASK_SIZE;
+	uint bit_idx = index % BITMASK_SIZE;
+
+	return (mask[mask_idx] & (1UL << bit_idx)) != 0;
+}
+
+/*
+	Gumbel-max sampling: every candidate draws its own uniform u and gets the key log(weight) - log(-log(u)).
+	The candidate with the largest key is distributed exactly like a roulette draw over the weights,
+	so a single max-reduction replaces the prefix scan and the ranged search.
+*/
+#ifdef WORK_SIZE
+__attribute__((reqd_work_group_size(WORK_SIZE, 1, 1)))
+#endif
+void kernel wander_ant(
+global const double* probabilities,
+global const int* weights,
+global const bitmask* dependencies,
+global int* ant_routes,
+global int* ant_route_length,
+local double* ant_key,
+local int* ant_choice,
+local int* ant_allowed,
+global const int* ant_allowed_template,
+int problem_size,
+global uint* rng_seeds) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	int ant_idx = get_group_id(1);
+	int worker_idx = get_local_id(0);
+#ifdef WORK_SIZE
+	const int worker_size = WORK_SIZE;
+#else
+	int worker_size = get_local_size(0);
+#endif
+
+	int* ant_route = ant_routes + ant_idx * problem_size;
+	double* key = ant_key;
+	int* choice = ant_choice;
+	int* allowed = ant_allowed;
+	uint* seed = rng_seeds + ant_idx;
+	const uint ant_seed = *seed;
+#ifdef BITMASK_WORDS
+	const int bitmask_size = BITMASK_WORDS;
+#else
+	const int bitmask_size = problem_size / BITMASK_SIZE + (problem_size % BITMASK_SIZE != 0 ? 1 : 0);
+#endif
+
+	const bool is_candidate = worker_idx < problem_size;
+	int route_length = 0;
+
+	local int current_node;
+	if (worker_idx == 0) {
+		current_node = 0;
+	}
+	if (is_candidate) {
+		allowed[worker_idx] = ant_allowed_template[worker_idx];
+	}
+	for (int i = 1; i < problem_size; i++) {
+		barrier(CLK_LOCAL_MEM_FENCE);
+		double weight = is_candidate && allowed[worker_idx] == 0 ? probabilities[current_node * problem_size + worker_idx] : 0.0;
+		key[worker_idx] = weight > 0.0 ? log(weight) - log(-log(rng_unit(ant_seed, i, worker_idx))) : -INFINITY;
+		choice[worker_idx] = weight > 0.0 ? worker_idx : -1;
+
+		// Max-Reduction
+		for (int stride = worker_size / 2; stride > 0; stride /= 2) {
+			barrier(CLK_LOCAL_MEM_FENCE);
+			if (worker_idx < stride && key[worker_idx + stride] > key[worker_idx]) {
+				key[worker_idx] = key[worker_idx + stride];
+				choice[worker_idx] = choice[worker_idx + stride];
+			}
+		}
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (worker_idx == 0) {
+			int next_node = choice[0];
+			if (next_node < 0) {
+				current_node = -1;
+			}
+			else {
+				route_length += weights[current_node * problem_size + next_node];
+
+				current_node = next_node;
+				ant_route[i] = next_node;
+				allowed[next_node] = -1;
+			}
+		}
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (current_node < 0) {
+			break;
+		}
+
+		const bitmask* dep_mask = dependencies + current_node * bitmask_size;
+		if (is_candidate && has_bit(dep_mask, worker_idx)) {
+			// node `worker_idx` depends on current_node => Update allowed entry
+			allowed[worker_idx] -= 1;
+		}
+	}
+
+	if (worker_idx == 0) {
+		ant_route_length[ant_idx] = (current_node == problem_size - 1) ? route_length : INT_MAX;
+		// Next round draws fresh uniforms
+		rng_minstd_rand0(seed);
+	}
+}
+
+
+void kernel update_pheromone(
+global double* pheromone,
+global double* probabilities,
+global double* visibility,
+double alpha,
+double one_minus_roh,
+double min_pheromone,
+double max_pheromone,
+global const int* ant_routes,
+global const int* best_ant,
+double q,
+int problem_size
+) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	const int best_ant_idx = best_ant[0];
+	const double best_ant_pheromone = q / best_ant[1];
+	int edge = get_global_id(0);
+	int from = edge / problem_size;
+	int to = edge % problem_size;
+	const int* best_ant_route = ant_routes + best_ant_idx * problem_size;
+
+	// Evaporate
+	pheromone[edge] *= one_minus_roh;
+
+	// Lay along best_ant
+	//? Could be "optimized" by looping one short, thereby removing the check for i+1 to be a valid index
+
+	//? Could also be made obsolete if a bitmask exists, containing each edge and whether it is part of the best_route (1) or not (0)
+
+	//? How about a list of each node containing the next node in the route
+	//? This would require reimagining the meaning of ant_route but nothing more
+	//? Because each node MUST occure in the route, there are as many entries as there are nodes
+	//? Currently, ant_route[index] is the node where ant was at step no #index
+	//? But ant_route[index] could also be interpreted as the next node that was chosen while standing at node "index"
+	//? No information would be lost (although retrieving the step-by-step best route would be slightly more complex)
+	//? But the following algorithm would be made possible
+	/*
+	? next_arr[problem_size]
+	? if next_arr[from] == to {
+	? 	pheromone[edge] += best_ant_pheromone
+	? }
+	*/
+	for (int i = 0; i < problem_size; i++) {
+		if (best_ant_route[i] != from) {
+			continue;
+		}
+
+		if (i + 1 >= problem_size) {
+			 continue;
+		}
+
+		if (best_ant_route[i + 1] != to) {
+			continue;
+		}
+
+		pheromone[edge] += best_ant_pheromone;
+	}
+
+	pheromone[edge] = clamp(pheromone[edge], min_pheromone, max_pheromone);
+
+	probabilities[edge] = powr(pheromone[edge], alpha) * visibility[edge];
+}
+
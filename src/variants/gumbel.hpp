@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <random>
+#include <bitset>
+#include <type_traits>
+
+#include "clcolony.hpp"
+#include "../profiler.hpp"
+
+/*
+	Work-group per ant like localant, but picks the next node by Gumbel-max sampling
+	with a single max-reduction instead of a prefix scan and ranged search.
+*/
+class GumbelOptimizer: public CLColonyOptimizer {
+protected:
+	cl::Program program;
+	cl::KernelFunctor<
+		cl::Buffer, // probabilities
+		cl::Buffer, // weights
+		cl::Buffer, // dependencies
+		cl::Buffer, // ant_routes
+		cl::Buffer, // ant_routes_length
+		cl::LocalSpaceArg, // ant_key
+		cl::LocalSpaceArg, // ant_choice
+		cl::LocalSpaceArg, // ant_allowed
+		cl::Buffer, // ant_allowed_template
+		cl_int,     // problem_size
+		cl::Buffer  // rng_seeds
+	> advanceAntsCL;
+
+	cl::KernelFunctor<
+		cl::Buffer, // pheromone
+		cl::Buffer, // probabilities
+		cl::Buffer, // visibility
+		cl_double, // alpha
+		cl_double, // one_minus_roh
+		cl_double, // min_pheromone
+		cl_double, // max_pheromone
+		cl::Buffer, // ant_routes
+		cl::Buffer, // best_ant
+		cl_double, // q
+		cl_int  // problem_size
+	> updatePheromoneCL;
+
+	cl::Buffer pheromone_d;
+	cl::Buffer visibility_d;
+	cl::Buffer weights_d;
+	cl::Buffer routes_d;
+	cl::Buffer routes_length_d;
+	cl::LocalSpaceArg ant_key_d;
+	cl::LocalSpaceArg ant_choice_d;
+	cl::LocalSpaceArg ant_allowed_d;
+	cl::Buffer ant_allowed_template_d;
+	cl::Buffer rng_seeds_d;
+	cl::Buffer probabilities_d;
+	cl::Buffer dependencies_d;
+
+	size_t work_size = 0;
+
+	size_t leftmost_one(size_t value) {
+		int i = 0;
+		for (; i < sizeof(size_t) * 8; i++) {
+			if (value >> i == 0) { return i; }
+		}
+		return i;
+	}
+
+	StageEvents advanceAnts(const StageEvents& wait_for) {
+		cl::NDRange global_size(work_size, ant_count);
+		cl::NDRange local_size(work_size, 1);
+		return { advanceAntsCL(
+			cl::EnqueueArgs(queue, wait_for, global_size, local_size),
+			probabilities_d,
+			weights_d,
+			dependencies_d,
+			routes_d,
+			routes_length_d,
+			ant_key_d,
+			ant_choice_d,
+			ant_allowed_d,
+			ant_allowed_template_d,
+			problem.size(),
+			rng_seeds_d			
+		) };
+	}
+
+	StageEvents updatePheromone(const StageEvents& wait_for, double q) {
+		cl::NDRange global_size(problem.size() * problem.size());
+		return { updatePheromoneCL(
+			cl::EnqueueArgs(queue, wait_for, global_size),
+			pheromone_d,
+			probabilities_d,
+			visibility_d,
+			params.alpha,
+			1 - params.rho,
+			params.min_pheromone,
+			params.max_pheromone,
+			routes_d,
+			best_ant_d,
+			q,
+			problem.size()
+		) };
+	}
+
+public:
+	static constexpr const char* static_name = "gumbel";
+	static constexpr const char* static_params = "";
+
+	GumbelOptimizer(Problem problem, AntParams params)
+	:	CLColonyOptimizer::CLColonyOptimizer(problem, params),
+		advanceAntsCL(cl::Kernel()),
+		updatePheromoneCL(cl::Kernel()),
+		pheromone(problem.size(), params.initial_pheromone) {}
+
+	Graph<double> pheromone;
+
+	/*
+	Samples and allowed counters stay in local memory, only the probabilities row
+	and the dependency bits of the chosen node go through global memory.
+	Every candidate takes three logarithms and a subtraction for its Gumbel key
+	*/
+	RoundCost roundCost() const override {
+		RoundCost cost = CLColonyOptimizer::roundCost();
+		const double n = problem.size();
+		const double steps = ant_count * (n - 1);
+		cost.advance.bytes = steps * (n * sizeof(double) + n / 8);
+		cost.advance.flops = steps * 4 * n;
+		return cost;
+	}
+
+	void prepare() override {
+		setupCL(false);
+		work_size = 1UL << leftmost_one(problem.size() - 1);
+		program = loadProgramVariant(static_name, specializationArgs(work_size));
+
+		pheromone_d = createAndFillBuffer("pheromone", problem.sizeSqr(), false, pheromone);
+		weights_d = wrapHostBuffer("weights", problem.weights);
+		routes_d = createAndFillBuffer<int>("routes", ant_count * problem.size(), false, 0);
+		routes_length_d = createAndFillBuffer("routes_length", ant_count, false, std::numeric_limits<cl_int>::max());
+		probabilities_d = createAndFillBuffer<double>("probabilities", problem.sizeSqr(), false, 0.0);
+		ant_key_d = createLocalBuffer<double>(work_size);
+		ant_choice_d = createLocalBuffer<int>(work_size);
+		ant_allowed_d = createLocalBuffer<int>(problem.size());
+
+		dependencies_d = createDependencyBuffer(false);
+
+		visibility_d = createVisibilityBuffer();
+
+		std::vector<int> allowed_template = getAllowedList();
+		ant_allowed_template_d = createAndFillBuffer("ant_allowed_template", allowed_template.size(), true, allowed_template);
+
+		std::vector<uint> rngs = getRngs();
+		rng_seeds_d = createAndFillBuffer("rng_seeds", rngs.size(), false, rngs);
+
+		setupBestAnt();
+		queue.finish();
+
+		advanceAntsCL = decltype(advanceAntsCL)(cl::Kernel(program, "wander_ant"));
+		updatePheromoneCL = decltype(updatePheromoneCL)(cl::Kernel(program, "update_pheromone"));
+
+		updatePheromone({}, 0);
+		queue.finish();
+	}
+
+	void optimize(unsigned int rounds) override {
+		runPipeline(rounds, routes_length_d,
+			[this](const StageEvents& wait_for) { return advanceAnts(wait_for); },
+			[this](const StageEvents& wait_for) { return updatePheromone(wait_for, params.q); });
+	}
+};
+
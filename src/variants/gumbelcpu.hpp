@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "sequential.hpp"
+
+// The hash shifts every lane by its own amount, which x86 vectors only do from AVX2 on.
+// Linux builds get an AVX2 clone of the scoring loop next to the baseline one, picked when the program loads.
+#if defined(__x86_64__) && defined(__linux__)
+#define GUMBEL_SIMD_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define GUMBEL_SIMD_CLONES
+#endif
+
+/*
+	Sequential colony drawing the next node by Gumbel-max sampling like the "gumbel" OpenCL variant.
+	Every candidate is scored in one branch-free pass over a contiguous row of log weights,
+	followed by a single arg-max instead of a running-sum roulette.
+	The log weights are refreshed once per update, so a step only pays for the Gumbel noise of each candidate.
+	The noise uses an inline logarithm built from integer and floating-point arithmetic only,
+	so the compiler vectorizes the pass (checked with -fopt-info-vec / -Rpass=loop-vectorize) instead of calling libm per candidate.
+*/
+class GumbelCpuOptimizer: public SequentialOptimizer {
+public:
+	static constexpr const char* static_name = "gumbelcpu";
+	static constexpr const char* static_params = "";
+
+	using SequentialOptimizer::SequentialOptimizer;
+
+	void prepare() override {
+		SequentialOptimizer::prepare();
+
+		log_visibility = Graph<double>(problem.size());
+		std::transform(visibility.adjacency_matrix.data.cbegin(), visibility.adjacency_matrix.data.cend(),
+			log_visibility.adjacency_matrix.data.begin(), [](const double& v) { return std::log(v); });
+		log_weight = Graph<double>(problem.size());
+		pheromoneUpdated();
+		keys.resize(problem.size());
+		node_hash.resize(problem.size());
+		for (size_t node = 0; node < node_hash.size(); node++) {
+			node_hash[node] = hash_uint(node);
+		}
+
+		host_memory.add("log_visibility", sizeof(double) * log_visibility.adjacency_matrix.data.size());
+		host_memory.add("log_weight", sizeof(double) * log_weight.adjacency_matrix.data.size());
+	}
+
+protected:
+	// log((visibility)^(beta))
+	Graph<double> log_visibility;
+	// log(pheromone^alpha * visibility^beta) = alpha * log(pheromone) + log_visibility
+	Graph<double> log_weight;
+	std::vector<double> keys;
+	// hash_uint of every node, the part of a candidate's counter that does not change between steps
+	std::vector<uint32_t> node_hash;
+
+	void pheromoneUpdated() override {
+		const double alpha = params.alpha;
+		std::transform(pheromone.adjacency_matrix.data.cbegin(), pheromone.adjacency_matrix.data.cend(),
+			log_visibility.adjacency_matrix.data.cbegin(), log_weight.adjacency_matrix.data.begin(),
+			[alpha](const double& p, const double& lv) { return alpha * std::log(p) + lv; });
+	}
+
+	// Same counter-based generator as gumbel.cl
+	static uint32_t hash_uint(uint32_t x) {
+		uint32_t state = x * 747796405u + 2891336453u;
+		uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+		return (word >> 22u) ^ word;
+	}
+
+	static double from_bits(uint64_t bits) {
+		double value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	/*
+	Natural logarithm of a positive, finite, normal x without branches or table lookups.
+	Splits x into 2^e * m with m in [sqrt(1/2), sqrt(2)) and sums 2 * atanh((m - 1) / (m + 1)) up to s^13,
+	relative error below 1e-11. Conversions go through the exponent bits of 2^52,
+	as vectors of 64-bit integers only convert to double with AVX-512.
+	*/
+	static double log_approx(double x) {
+		uint64_t bits;
+		std::memcpy(&bits, &x, sizeof(bits));
+		const uint64_t mantissa = bits & 0x000fffffffffffffULL;
+		// Mantissas above sqrt(2) are halved, moving one into the exponent
+		const uint64_t high = mantissa > 0x6a09e667f3bcdULL;
+		const double m = from_bits(mantissa | (0x3ff0000000000000ULL - (high << 52)));
+		const double e = from_bits(0x4330000000000000ULL | ((bits >> 52) + high)) - (4503599627370496.0 + 1023.0);
+
+		const double s = (m - 1.0) / (m + 1.0);
+		const double s2 = s * s;
+		const double series = 1.0 + s2 * (1.0 / 3 + s2 * (1.0 / 5 + s2 * (1.0 / 7 + s2 * (1.0 / 9 + s2 * (1.0 / 11 + s2 * (1.0 / 13))))));
+		return e * 0.6931471805599453 + 2.0 * s * series;
+	}
+
+	/*
+	Gumbel-max key of every candidate, -infinity for the ones not allowed
+	*/
+	GUMBEL_SIMD_CLONES
+	static void score(double* key, const double* log_weight_row, const int* allowed, const uint32_t* node_hash, uint32_t step_seed, size_t size) {
+		const double no_key = -std::numeric_limits<double>::infinity();
+		for (size_t next = 0; next < size; next++) {
+			const uint64_t hash = hash_uint(step_seed ^ node_hash[next]);
+			// (hash + 0.5) / 2^32 in (0, 1), hash converted through the exponent bits of 2^52
+			const double u = (from_bits(0x4330000000000000ULL | hash) - 4503599627370496.0 + 0.5) * (1.0 / 4294967296.0);
+			// Selecting a constant instead of the key keeps the loop free of branches
+			key[next] = log_weight_row[next] - log_approx(-log_approx(u)) + (allowed[next] == 0 ? 0.0 : no_key);
+		}
+	}
+
+	int choose_next(Ant& ant) override {
+		const uint32_t step_seed = ant.random_generator();
+		const double no_key = -std::numeric_limits<double>::infinity();
+		score(keys.data(), &log_weight.edge(ant.current_node, 0), ant.allowed_nodes.data(), node_hash.data(), step_seed, problem.size());
+
+		auto best = std::max_element(keys.begin(), keys.end());
+		if (*best == no_key) {
+			return -1;
+		}
+		return std::distance(keys.begin(), best);
+	}
+};
@@ -0,0 +1,118 @@
+
+uint rng_minstd_rand0(global uint* state) {
+	const uint a = 16807;
+	const uint m = 2147483647;
+	// Schrage's decomposition m = a * q + r keeps a * state % m within 32 bits
+	const uint q = 127773;
+	const uint r = 2836;
+
+	uint a_lo = a * (*state % q);
+	uint r_hi = r * (*state / q);
+	*state = a_lo >= r_hi ? a_lo - r_hi : a_lo + (m - r_hi);
+
+	return *state;
+}
+
+double rng_range(global uint* state, double max) {
+	uint r = rng_minstd_rand0(state);
+	double dr = (double)r / 2147483647.0;
+	return dr * max;
+}
+
+void construct_route(
+global const double* probabilities,
+global const int* weights,
+global int* ant_route,
+global int* route_length,
+global double* sample,
+global int* allowed,
+global const int* allowed_template,
+int problem_size,
+global uint* seed) {
+	for (int i = 0; i < problem_size; i++) {
+		allowed[i] = allowed_template[i];
+	}
+
+	int current_node = 0;
+	*route_length = 0;
+	for (int i = 1; i < problem_size; i++) {
+		double sample_sum = 0.0;
+		bool hasPossibleNext = false;
+		for (int next = 0; next < problem_size; next++) {
+			if (allowed[next] != 0) {
+				sample[next] = 0.0;
+				continue;
+			}
+			double edge_value = probabilities[current_node * problem_size + next];
+			sample[next] = edge_value;
+			sample_sum += edge_value;
+
+			hasPossibleNext = true;
+		}
+
+		if (!hasPossibleNext) {
+			current_node = -1;
+			break;
+		}
+
+		double rng = rng_range(seed, sample_sum);
+		int next_node = -1;
+		for (int n = 0; n < problem_size; n++) {
+			rng -= sample[n];
+			if (rng < 0) {
+				next_node = n;
+				break;
+			}
+		}
+		if (next_node < 0) {
+			current_node = -1;
+			break;
+		}
+
+		*route_length += weights[current_node * problem_size + next_node];
+
+		current_node = next_node;
+		ant_route[i] = next_node;
+		allowed[next_node] = -1;
+
+		for (int n = 0; n < problem_size; n++) {
+			if (weights[n * problem_size + next_node] == -1) {
+				allowed[n] -= 1;
+			}
+		}
+	}
+
+	if (current_node != problem_size - 1) {
+		*route_length = INT_MAX;
+	}
+}
+
+/*
+	One work-item per device ant, the device takes ants [0, get_global_size(0))
+	and reads the probabilities mirrored from the host every round
+*/
+void kernel wander_ant(
+global const double* probabilities,
+global const int* weights,
+global int* ant_routes,
+global int* ant_route_length,
+global double* ant_sample,
+global int* ant_allowed,
+global const int* allowed_template,
+int problem_size,
+global uint* rng_seeds) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	const int ant_idx = get_global_id(0);
+	construct_route(
+		probabilities,
+		weights,
+		ant_routes + ant_idx * problem_size,
+		ant_route_length + ant_idx,
+		ant_sample + ant_idx * problem_size,
+		ant_allowed + ant_idx * problem_size,
+		allowed_template,
+		problem_size,
+		rng_seeds + ant_idx);
+}
@@ -0,0 +1,358 @@
+#pragma once
+
+#include <algorithm>
+#include <random>
+#include <thread>
+
+#include "clcolony.hpp"
+#include "../profiler.hpp"
+
+/*
+	Splits the ants of every round between CPU threads and the OpenCL device.
+	The host owns the pheromone matrix, the device reads a mirror of the probabilities written each round.
+	The share of device ants follows the ants per second both sides managed in recent rounds.
+	Colony arguments:
+		threads: CPU threads (default: hardware concurrency)
+		overlap: Update from round r on a separate thread while round r + 1 constructs
+			against the probabilities of round r - 1, kept in a second host buffer
+*/
+class HybridOptimizer: public CLColonyOptimizer {
+protected:
+	cl::Program program;
+	cl::KernelFunctor<
+		cl::Buffer, // probabilities
+		cl::Buffer, // weights
+		cl::Buffer, // ant_routes
+		cl::Buffer, // ant_routes_length
+		cl::Buffer, // ant_sample
+		cl::Buffer, // ant_allowed
+		cl::Buffer, // allowed_template
+		cl_int,     // problem_size
+		cl::Buffer  // rng_seeds
+	> advanceAntsCL;
+
+	cl::Buffer probabilities_d;
+	cl::Buffer weights_d;
+	cl::Buffer routes_d;
+	cl::Buffer routes_length_d;
+	cl::Buffer ant_sample_d;
+	cl::Buffer ant_allowed_d;
+	cl::Buffer allowed_template_d;
+	cl::Buffer rng_seeds_d;
+
+	// Ants read probabilities[front], an overlapped update writes the other one
+	std::array<Graph<double>, 2> probabilities;
+	int front = 0;
+	std::vector<int> allowed_template;
+
+	// Per ant host state, only the entries of CPU ants are used in a round.
+	// The seeds of an ant live on the side it runs on, rebalance() moves them along with the ant
+	std::vector<uint32_t> cpu_seeds;
+	std::vector<int> cpu_routes;
+	std::vector<int> cpu_allowed;
+	std::vector<double> cpu_sample;
+	std::vector<int> route_lengths;
+
+	unsigned int thread_count = 1;
+	bool overlapRounds = false;
+	size_t device_ants = 0;
+	// Smoothed throughput in ants per second, 0 until measured
+	double device_rate = 0.0;
+	double cpu_rate = 0.0;
+	// Weight of the latest round in the smoothed throughput
+	static constexpr double rate_smoothing = 0.25;
+
+	// Same generator as hybrid.cl, so both sides draw alike
+	static uint32_t rng_minstd_rand0(uint32_t& state) {
+		const uint64_t a = 16807;
+		const uint64_t m = 2147483647;
+		state = (a * state) % m;
+		return state;
+	}
+
+	void constructRoute(size_t ant_idx) {
+		const size_t size = problem.size();
+		int* route = &cpu_routes[ant_idx * size];
+		int* allowed = &cpu_allowed[ant_idx * size];
+		double* sample = &cpu_sample[ant_idx * size];
+		int& route_length = route_lengths[ant_idx];
+		std::copy(allowed_template.begin(), allowed_template.end(), allowed);
+
+		int current_node = 0;
+		route_length = 0;
+		for (size_t i = 1; i < size; i++) {
+			const double* row = &probabilities[front].edge(current_node, 0);
+			double sample_sum = 0.0;
+			bool hasPossibleNext = false;
+			for (size_t next = 0; next < size; next++) {
+				sample[next] = allowed[next] == 0 ? row[next] : 0.0;
+				sample_sum += sample[next];
+				hasPossibleNext = hasPossibleNext || allowed[next] == 0;
+			}
+			if (!hasPossibleNext) {
+				current_node = -1;
+				break;
+			}
+
+			double rng = static_cast<double>(rng_minstd_rand0(cpu_seeds[ant_idx])) / 2147483647.0 * sample_sum;
+			int next_node = -1;
+			for (size_t n = 0; n < size; n++) {
+				rng -= sample[n];
+				if (rng < 0) {
+					next_node = n;
+					break;
+				}
+			}
+			if (next_node < 0) {
+				current_node = -1;
+				break;
+			}
+
+			route_length += problem.weights.edge(current_node, next_node);
+			current_node = next_node;
+			route[i] = next_node;
+			allowed[next_node] = -1;
+			for (size_t n = 0; n < size; n++) {
+				if (problem.weights.edge(n, next_node) == -1) {
+					allowed[n] -= 1;
+				}
+			}
+		}
+
+		if (current_node != static_cast<int>(size) - 1) {
+			route_length = std::numeric_limits<int>::max();
+		}
+	}
+
+	/*
+	Constructs the CPU ants [device_ants, ant_count), each thread takes every thread_count-th ant
+	*/
+	void advanceCpuAnts() {
+		std::vector<std::thread> workers;
+		for (unsigned int t = 1; t < thread_count; t++) {
+			workers.emplace_back([this, t]() {
+				for (size_t ant = device_ants + t; ant < ant_count; ant += thread_count) {
+					constructRoute(ant);
+				}
+			});
+		}
+		for (size_t ant = device_ants; ant < ant_count; ant += thread_count) {
+			constructRoute(ant);
+		}
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+	}
+
+	cl::Event advanceDeviceAnts(const std::vector<cl::Event>& wait_for) {
+		cl::NDRange global_size(device_ants);
+		return advanceAntsCL(
+			cl::EnqueueArgs(queue, wait_for, global_size),
+			probabilities_d,
+			weights_d,
+			routes_d,
+			routes_length_d,
+			ant_sample_d,
+			ant_allowed_d,
+			allowed_template_d,
+			problem.size(),
+			rng_seeds_d
+		);
+	}
+
+	static double smoothRate(double rate, size_t ants, Profiler::Duration duration) {
+		double seconds = std::chrono::duration<double>(duration).count();
+		if (ants == 0 || seconds <= 0.0) {
+			return rate;
+		}
+		double measured = ants / seconds;
+		return rate == 0.0 ? measured : rate + rate_smoothing * (measured - rate);
+	}
+
+	/*
+	Splits the next round proportionally to the measured throughput, keeping at least one ant per side
+	so both keep being measured. Must not run while device ants construct.
+	*/
+	void rebalance() {
+		const size_t previous = device_ants;
+		if (ant_count < 2) {
+			device_ants = ant_count;
+		}
+		else {
+			double device_share = device_rate + cpu_rate > 0.0 ? device_rate / (device_rate + cpu_rate) : 0.5;
+			device_ants = std::clamp<size_t>(std::llround(device_share * ant_count), 1, ant_count - 1);
+		}
+
+		// Ants changing sides continue their random stream instead of replaying it from a stale seed
+		if (device_ants > previous) {
+			queue.enqueueWriteBuffer(rng_seeds_d, CL_FALSE, sizeof(uint32_t) * previous, sizeof(uint32_t) * (device_ants - previous), &cpu_seeds[previous]);
+		}
+		else if (device_ants < previous) {
+			readBuffer(rng_seeds_d, device_ants, previous - device_ants, &cpu_seeds[device_ants]);
+		}
+	}
+
+	void updateProbabilities(Graph<double>& target) {
+		std::transform(pheromone.adjacency_matrix.data.cbegin(), pheromone.adjacency_matrix.data.cend(),
+			visibility.adjacency_matrix.data.cbegin(), target.adjacency_matrix.data.begin(),
+			[this](const double& p, const double& v) { return std::pow(p, params.alpha) * v; });
+	}
+
+	/*
+	Evaporates, lays pheromone along `route` and refreshes `target` from the result
+	*/
+	void updatePheromone(const std::vector<int>& route, int route_length, Graph<double>& target) {
+		for (auto& value : pheromone.adjacency_matrix.data) {
+			value *= (1.0 - params.rho);
+		}
+
+		// Lay pheromone along the route of the best ant
+		if (route_length < std::numeric_limits<int>::max()) {
+			double spread = params.q / route_length;
+			for (auto it = std::next(route.begin()); it != route.end(); it++) {
+				auto prev = std::prev(it);
+				pheromone.edge(*prev, *it) += spread;
+			}
+		}
+
+		// clamp all pheromone values
+		for (auto& value : pheromone.adjacency_matrix.data) {
+			value = std::clamp(value, params.min_pheromone, params.max_pheromone);
+		}
+		updateProbabilities(target);
+	}
+
+public:
+	static constexpr const char* static_name = "hybrid";
+	static constexpr const char* static_params = "threads=<count>,overlap";
+
+	HybridOptimizer(Problem problem, AntParams params)
+	:	CLColonyOptimizer::CLColonyOptimizer(problem, params),
+		advanceAntsCL(cl::Kernel()),
+		probabilities { Graph<double>(problem.size()), Graph<double>(problem.size()) },
+		pheromone(problem.size(), params.initial_pheromone),
+		visibility(problem.size()) {
+		thread_count = params.variant_args.get<unsigned int>("threads", std::max(1U, std::thread::hardware_concurrency()));
+		if (thread_count == 0) {
+			throw std::invalid_argument("hybrid: at least one CPU thread is required");
+		}
+		overlapRounds = params.variant_args.get<bool>("overlap", false);
+	}
+
+	Graph<double> pheromone;
+	Graph<double> visibility;
+
+	void prepare() override {
+		setupCL(false);
+		program = loadProgramVariant(static_name, specializationArgs());
+
+		visibility = getVisibility();
+		updateProbabilities(probabilities[front]);
+		allowed_template = getAllowedList();
+
+		probabilities_d = createAndFillBuffer("probabilities", problem.sizeSqr(), true, probabilities[front]);
+		weights_d = wrapHostBuffer("weights", problem.weights);
+		routes_d = createAndFillBuffer<int>("routes", ant_count * problem.size(), false, 0);
+		routes_length_d = createAndFillBuffer("routes_length", ant_count, false, std::numeric_limits<cl_int>::max());
+		ant_sample_d = createBuffer<double>("ant_sample", ant_count * problem.size(), false);
+		ant_allowed_d = createBuffer<int>("ant_allowed", ant_count * problem.size(), false);
+		allowed_template_d = createAndFillBuffer("allowed_template", allowed_template.size(), true, allowed_template);
+
+		std::vector<uint> rngs = getRngs();
+		rng_seeds_d = createAndFillBuffer("rng_seeds", rngs.size(), false, rngs);
+		cpu_seeds.assign(rngs.begin(), rngs.end());
+
+		cpu_routes.assign(ant_count * problem.size(), 0);
+		cpu_allowed.resize(ant_count * problem.size());
+		cpu_sample.resize(ant_count * problem.size());
+		route_lengths.resize(ant_count);
+		rebalance();
+
+		host_memory.add("pheromone", sizeof(double) * pheromone.adjacency_matrix.data.size());
+		host_memory.add("visibility", sizeof(double) * visibility.adjacency_matrix.data.size());
+		host_memory.add("probabilities", 2 * sizeof(double) * problem.sizeSqr());
+		host_memory.add("routes", sizeof(int) * cpu_routes.size());
+		host_memory.add("allowed", sizeof(int) * cpu_allowed.size());
+		host_memory.add("sample", sizeof(double) * cpu_sample.size());
+
+		queue.finish();
+
+		advanceAntsCL = decltype(advanceAntsCL)(cl::Kernel(program, "wander_ant"));
+	}
+
+	void optimize(unsigned int rounds) override {
+		std::vector<int> best_route(problem.size());
+		int best_length = std::numeric_limits<int>::max();
+		bool update_pending = false;
+		while (rounds-- > 0) {
+			Profiler::start("opts");
+
+			Profiler::start("adva");
+			const Graph<double>& current = probabilities[front];
+			cl::Event mirrored;
+			queue.enqueueWriteBuffer(
+				probabilities_d, CL_FALSE, 0,
+				sizeof(double) * current.adjacency_matrix.data.size(),
+				current.adjacency_matrix.data.data(),
+				nullptr, &mirrored);
+			cl::Event device_done = advanceDeviceAnts({ mirrored });
+			queue.flush();
+
+			// The route of the last round is only read by the updater until it is joined
+			Profiler::Duration update_duration {};
+			std::thread updater;
+			if (update_pending) {
+				updater = std::thread([this, &best_route, best_length, &update_duration]() {
+					auto update_start = Profiler::Clock::now();
+					updatePheromone(best_route, best_length, probabilities[1 - front]);
+					update_duration = Profiler::Clock::now() - update_start;
+				});
+			}
+
+			auto cpu_start = Profiler::Clock::now();
+			advanceCpuAnts();
+			Profiler::Duration cpu_duration = Profiler::Clock::now() - cpu_start;
+
+			if (updater.joinable()) {
+				updater.join();
+				Profiler::record("upda", update_duration);
+				front = 1 - front;
+				update_pending = false;
+			}
+
+			readBuffer(routes_length_d, 0, device_ants, route_lengths.data());
+			Profiler::stop("adva");
+
+			Profiler::start("eval");
+			auto best_ant_it = std::min_element(route_lengths.begin(), route_lengths.end());
+			size_t best_ant_idx = std::distance(route_lengths.begin(), best_ant_it);
+			if (best_ant_idx < device_ants) {
+				readBuffer(routes_d, best_ant_idx * problem.size(), problem.size(), best_route.data());
+			}
+			else {
+				std::copy_n(cpu_routes.begin() + best_ant_idx * problem.size(), problem.size(), best_route.begin());
+			}
+			best_length = *best_ant_it;
+			best_route_length = std::min(best_length, best_route_length);
+			convergence.add(best_length);
+
+			traceStage("mirr", { mirrored }, 0);
+			traceStage("adva", { device_done }, 0);
+			device_rate = smoothRate(device_rate, device_ants, eventDuration(mirrored, device_done));
+			cpu_rate = smoothRate(cpu_rate, ant_count - device_ants, cpu_duration);
+			rebalance();
+			Profiler::stop("eval");
+
+			if (overlapRounds) {
+				update_pending = true;
+			}
+			else {
+				Profiler::start("upda");
+				updatePheromone(best_route, best_length, probabilities[front]);
+				Profiler::stop("upda");
+			}
+
+			Profiler::stop("opts");
+		}
+	}
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstring>
+#include <cstddef>
+
+/*
+	OpenCL kernels compiled into the executable by `make` (see tools/embed_kernels.sh).
+	Without the generated header, no kernels are embedded and programs are loaded from disk.
+*/
+struct EmbeddedKernel {
+	const char* name;
+	const char* source;
+	const unsigned char* spirv;
+	size_t spirv_size;
+};
+
+#if __has_include("embedded_kernels.hpp")
+#include "embedded_kernels.hpp"
+
+inline const EmbeddedKernel* findEmbeddedKernel(const char* name) {
+	for (const EmbeddedKernel& kernel : embedded_kernels) {
+		if (std::strcmp(kernel.name, name) == 0) {
+			return &kernel;
+		}
+	}
+	return nullptr;
+}
+#else
+inline const EmbeddedKernel* findEmbeddedKernel(const char* name) {
+	return nullptr;
+}
+#endif
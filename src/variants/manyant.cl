@@ -1,17 +1,21 @@
 
 uint rng_minstd_rand0(uint* state) {
 	const uint a = 16807;
-	const uint c = 0;
 	const uint m = 2147483647;
+	// Schrage's decomposition m = a * q + r keeps a * state % m within 32 bits
+	const uint q = 127773;
+	const uint r = 2836;
 
-	*state = (a * (*state) + c) % m;
+	uint a_lo = a * (*state % q);
+	uint r_hi = r * (*state / q);
+	*state = a_lo >= r_hi ? a_lo - r_hi : a_lo + (m - r_hi);
 
 	return *state;
 }
 
 double rng_range(uint* state, double max) {
 	uint r = rng_minstd_rand0(state);
-	double dr = (double)r / (double)UINT_MAX;
+	double dr = (double)r / 2147483647.0;
 	return dr * max;
 }
 
@@ -23,15 +27,23 @@ global int* ant_routes,
 global int* ant_route_length,
 global double* ant_sample,
 global int* ant_allowed,
+global const int* allowed_template,
 int problem_size,
 double alpha,
 global uint* rng_seeds) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
 	int ant_idx = get_global_id(0);
 	int* ant_route = ant_routes + ant_idx * problem_size;
 	double* sample = ant_sample + ant_idx * problem_size;
 	int* allowed = ant_allowed + ant_idx * problem_size;
 	uint* seed = rng_seeds + ant_idx;
 
+	for (int i = 0; i < problem_size; i++) {
+		allowed[i] = allowed_template[i];
+	}
+
 	int current_node = 0;
 	int* route_length = ant_route_length + ant_idx;
 	*route_length = 0;
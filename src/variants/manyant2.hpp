@@ -17,6 +17,7 @@ protected:
 		cl::Buffer, // ant_routes_length
 		cl::Buffer, // ant_sample
 		cl::Buffer, // ant_allowed
+		cl::Buffer, // allowed_template
 		cl_int,     // problem_size
 		cl_double,  // alpha
 		cl::Buffer  // rng_seeds
@@ -29,12 +30,11 @@ protected:
 	cl::Buffer routes_length_d;
 	cl::Buffer ant_sample_d;
 	cl::Buffer ant_allowed_d;
+	cl::Buffer allowed_template_d;
 	cl::Buffer rng_seeds_d;
 
-	Graph<int> allowed_data;
-
 	void advanceAnts() {
-		cl::NDRange global_size(problem.size());
+		cl::NDRange global_size(ant_count);
 		advanceAntsCL(
 			cl::EnqueueArgs(queue, global_size),
 			pheromone_d,
@@ -44,6 +44,7 @@ protected:
 			routes_length_d,
 			ant_sample_d,
 			ant_allowed_d,
+			allowed_template_d,
 			problem.size(),
 			params.alpha,
 			rng_seeds_d			
@@ -68,27 +69,26 @@ public:
 		const size_t required_buffer_size = matrix_size * (sizeof(cl_double) + sizeof(cl_int));
 		const size_t constant_buffer_size = device.getInfo<CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE>();
 		if (constant_buffer_size < required_buffer_size) {
-			std::cerr << "[OpenCL] Constant buffer size too small: "
-				<< constant_buffer_size << " (required: " << required_buffer_size << ")" << std::endl;
-			exit(EXIT_FAILURE);
+			throw std::runtime_error("[OpenCL] Constant buffer size too small: "
+				+ std::to_string(constant_buffer_size) + " (required: " + std::to_string(required_buffer_size) + ")");
 		}
 
-		program = loadProgramVariant(static_name);
+		program = loadProgramVariant(static_name, specializationArgs());
 
-		pheromone_d = createAndFillBuffer(problem.sizeSqr(), false, pheromone);
-		weights_d = createAndFillBuffer(problem.sizeSqr(), true, problem.weights);
-		routes_d = createAndFillBuffer<int>(problem.sizeSqr(), false, 0);
-		routes_length_d = createAndFillBuffer(problem.size(), false, std::numeric_limits<cl_int>::max());
-		ant_sample_d = createAndFillBuffer<double>(problem.sizeSqr(), false, 0.0);
+		pheromone_d = createAndFillBuffer("pheromone", problem.sizeSqr(), false, pheromone);
+		weights_d = wrapHostBuffer("weights", problem.weights);
+		routes_d = createAndFillBuffer<int>("routes", ant_count * problem.size(), false, 0);
+		routes_length_d = createAndFillBuffer("routes_length", ant_count, false, std::numeric_limits<cl_int>::max());
+		ant_sample_d = createAndFillBuffer<double>("ant_sample", ant_count * problem.size(), false, 0.0);
 
-		Graph<double> visibility = getVisibility();
-		visibility_d = createAndFillBuffer(problem.sizeSqr(), true, visibility);
+		visibility_d = createVisibilityBuffer();
 
-		allowed_data = getAllowedData();
-		ant_allowed_d = createAndFillBuffer(problem.sizeSqr(), false, allowed_data);
+		ant_allowed_d = createBuffer<int>("ant_allowed", ant_count * problem.size(), false);
+		std::vector<int> allowed_template = getAllowedList();
+		allowed_template_d = createAndFillBuffer("allowed_template", allowed_template.size(), true, allowed_template);
 
 		std::vector<uint> rngs = getRngs();
-		rng_seeds_d = createAndFillBuffer(problem.size(), false, rngs);
+		rng_seeds_d = createAndFillBuffer("rng_seeds", rngs.size(), false, rngs);
 
 		queue.finish();
 
@@ -96,7 +96,7 @@ public:
 	}
 
 	void optimize(unsigned int rounds) override {
-		std::vector<int> ant_route_lengths(problem.size());
+		std::vector<int> ant_route_lengths(ant_count);
 		std::vector<int> ant_route(problem.size());
 		while (rounds-- > 0) {
 			Profiler::start("opts");
@@ -107,12 +107,13 @@ public:
 			Profiler::stop("adva");
 
 			Profiler::start("eval");
-			queue.enqueueReadBuffer(routes_length_d, CL_TRUE, 0, sizeof(int) * ant_route_lengths.size(), ant_route_lengths.data());
+			readBuffer(routes_length_d, 0, ant_route_lengths.size(), ant_route_lengths.data());
 			//l::copy(queue, routes_length_d, ant_route_lengths.begin(), ant_route_lengths.end());
 			auto best_ant_it = std::min_element(ant_route_lengths.begin(), ant_route_lengths.end());
 			size_t best_ant_idx = std::distance(ant_route_lengths.begin(), best_ant_it);
-			queue.enqueueReadBuffer(routes_d, CL_TRUE, best_ant_idx * problem.size() * sizeof(int), sizeof(int) * problem.size(), ant_route.data());
+			readBuffer(routes_d, best_ant_idx * problem.size(), problem.size(), ant_route.data());
 			best_route_length = std::min(*best_ant_it, best_route_length);
+			convergence.add(*best_ant_it);
 			Profiler::stop("eval");
 
 			Profiler::start("upda");
@@ -139,10 +140,6 @@ public:
 				pheromone_d, CL_TRUE, 0,
 				sizeof(double) * pheromone.adjacency_matrix.data.size(),
 				pheromone.adjacency_matrix.data.data());
-			queue.enqueueWriteBuffer(
-				ant_allowed_d, CL_TRUE, 0,
-				sizeof(int) * allowed_data.size(),
-				allowed_data.adjacency_matrix.data.data());
 			Profiler::stop("upda");
 
 			Profiler::stop("opts");
@@ -0,0 +1,208 @@
+
+uint rng_minstd_rand0(global uint* state) {
+	const uint a = 16807;
+	const uint m = 2147483647;
+	// Schrage's decomposition m = a * q + r keeps a * state % m within 32 bits
+	const uint q = 127773;
+	const uint r = 2836;
+
+	uint a_lo = a * (*state % q);
+	uint r_hi = r * (*state / q);
+	*state = a_lo >= r_hi ? a_lo - r_hi : a_lo + (m - r_hi);
+
+	return *state;
+}
+
+double rng_range(global uint* state, double max) {
+	uint r = rng_minstd_rand0(state);
+	double dr = (double)r / 2147483647.0;
+	return dr * max;
+}
+
+void construct_route(
+global const double* probabilities,
+global const int* weights,
+global int* ant_route,
+global int* route_length,
+global double* sample,
+global int* allowed,
+global const int* allowed_template,
+int problem_size,
+global uint* seed) {
+	for (int i = 0; i < problem_size; i++) {
+		allowed[i] = allowed_template[i];
+	}
+
+	int current_node = 0;
+	*route_length = 0;
+	for (int i = 1; i < problem_size; i++) {
+		double sample_sum = 0.0;
+		bool hasPossibleNext = false;
+		for (int next = 0; next < problem_size; next++) {
+			if (allowed[next] != 0) {
+				sample[next] = 0.0;
+				continue;
+			}
+			double edge_value = probabilities[current_node * problem_size + next];
+			sample[next] = edge_value;
+			sample_sum += edge_value;
+
+			hasPossibleNext = true;
+		}
+
+		if (!hasPossibleNext) {
+			current_node = -1;
+			break;
+		}
+
+		double rng = rng_range(seed, sample_sum);
+		int next_node = -1;
+		for (int n = 0; n < problem_size; n++) {
+			rng -= sample[n];
+			if (rng < 0) {
+				next_node = n;
+				break;
+			}
+		}
+		if (next_node < 0) {
+			current_node = -1;
+			break;
+		}
+
+		*route_length += weights[current_node * problem_size + next_node];
+
+		current_node = next_node;
+		ant_route[i] = next_node;
+		allowed[next_node] = -1;
+
+		for (int n = 0; n < problem_size; n++) {
+			if (weights[n * problem_size + next_node] == -1) {
+				allowed[n] -= 1;
+			}
+		}
+	}
+
+	if (current_node != problem_size - 1) {
+		*route_length = INT_MAX;
+	}
+}
+
+/*
+	One work-item per ant of this device's slice
+*/
+void kernel wander_ant(
+global const double* probabilities,
+global const int* weights,
+global int* ant_routes,
+global int* ant_route_length,
+global double* ant_sample,
+global int* ant_allowed,
+global const int* allowed_template,
+int problem_size,
+global uint* rng_seeds) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	const int ant_idx = get_global_id(0);
+	construct_route(
+		probabilities,
+		weights,
+		ant_routes + ant_idx * problem_size,
+		ant_route_length + ant_idx,
+		ant_sample + ant_idx * problem_size,
+		ant_allowed + ant_idx * problem_size,
+		allowed_template,
+		problem_size,
+		rng_seeds + ant_idx);
+}
+
+/*
+	Single work-group tree reduction over the slice, ties go to the lower index.
+	Leaves the length in slice_best[0] and the route in slice_best_route,
+	so the host only gathers those instead of every route.
+*/
+void kernel select_best_ant(
+global const int* ant_routes,
+global const int* ant_route_length,
+global int* slice_best,
+global int* slice_best_route,
+local int* reduce_length,
+local int* reduce_idx,
+int ant_count,
+int problem_size) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	const int lid = get_local_id(0);
+	const int worker_size = get_local_size(0);
+
+	int own_length = INT_MAX;
+	int own_idx = 0;
+	for (int i = lid; i < ant_count; i += worker_size) {
+		if (ant_route_length[i] < own_length) {
+			own_length = ant_route_length[i];
+			own_idx = i;
+		}
+	}
+	reduce_length[lid] = own_length;
+	reduce_idx[lid] = own_idx;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int stride = worker_size / 2; stride > 0; stride /= 2) {
+		if (lid < stride && (reduce_length[lid + stride] < reduce_length[lid]
+			|| (reduce_length[lid + stride] == reduce_length[lid] && reduce_idx[lid + stride] < reduce_idx[lid]))) {
+			reduce_length[lid] = reduce_length[lid + stride];
+			reduce_idx[lid] = reduce_idx[lid + stride];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	const global int* best_route = ant_routes + reduce_idx[0] * problem_size;
+	for (int i = lid; i < problem_size; i += worker_size) {
+		slice_best_route[i] = best_route[i];
+	}
+	if (lid == 0) {
+		slice_best[0] = reduce_length[0];
+	}
+}
+
+/*
+	Every device holds a replica of the pheromone matrix and applies the same broadcast deposit,
+	so the replicas stay identical without exchanging the matrix
+*/
+void kernel update_pheromone(
+global double* pheromone,
+global double* probabilities,
+global const double* visibility,
+double alpha,
+double one_minus_roh,
+double min_pheromone,
+double max_pheromone,
+global const int* best_route,
+int best_length,
+double q,
+int problem_size
+) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	int edge = get_global_id(0);
+	int from = edge / problem_size;
+	int to = edge % problem_size;
+
+	// Evaporate
+	pheromone[edge] *= one_minus_roh;
+
+	// Lay along the best ant of all devices, no deposit if every ant got stuck
+	if (best_length != INT_MAX) {
+		for (int i = 0; i + 1 < problem_size; i++) {
+			if (best_route[i] == from && best_route[i + 1] == to) {
+				pheromone[edge] += q / best_length;
+			}
+		}
+	}
+
+	pheromone[edge] = clamp(pheromone[edge], min_pheromone, max_pheromone);
+
+	probabilities[edge] = powr(pheromone[edge], alpha) * visibility[edge];
+}
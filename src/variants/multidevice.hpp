@@ -0,0 +1,370 @@
+#pragma once
+
+#include <algorithm>
+#include <random>
+
+#include "clcolony.hpp"
+#include "../profiler.hpp"
+
+/*
+	Splits the ants of a round across every matching device of the first platform,
+	in proportion to their compute units. Each device holds a replica of the pheromone matrix.
+	Only the best route of each device and its length are gathered, and the overall best route
+	is broadcast back for the deposit.
+	Colony arguments:
+		type: gpu, cpu or all devices (default gpu)
+		subdevices: split each device into this many sub-devices, e.g. a CPU runtime like PoCL
+*/
+class MultiDeviceOptimizer: public CLColonyOptimizer {
+protected:
+	using WanderAntFunctor = cl::KernelFunctor<
+		cl::Buffer, // probabilities
+		cl::Buffer, // weights
+		cl::Buffer, // ant_routes
+		cl::Buffer, // ant_routes_length
+		cl::Buffer, // ant_sample
+		cl::Buffer, // ant_allowed
+		cl::Buffer, // allowed_template
+		cl_int,     // problem_size
+		cl::Buffer  // rng_seeds
+	>;
+
+	using SelectBestAntFunctor = cl::KernelFunctor<
+		cl::Buffer, // ant_routes
+		cl::Buffer, // ant_routes_length
+		cl::Buffer, // slice_best
+		cl::Buffer, // slice_best_route
+		cl::LocalSpaceArg, // reduce_length
+		cl::LocalSpaceArg, // reduce_idx
+		cl_int,     // ant_count
+		cl_int      // problem_size
+	>;
+
+	using UpdatePheromoneFunctor = cl::KernelFunctor<
+		cl::Buffer, // pheromone
+		cl::Buffer, // probabilities
+		cl::Buffer, // visibility
+		cl_double, // alpha
+		cl_double, // one_minus_roh
+		cl_double, // min_pheromone
+		cl_double, // max_pheromone
+		cl::Buffer, // best_route
+		cl_int,    // best_length
+		cl_double, // q
+		cl_int     // problem_size
+	>;
+
+	/*
+	A device with its own queue, replicated matrices and a contiguous slice of the ants
+	*/
+	struct DeviceSlice {
+		cl::Device device;
+		cl::CommandQueue queue;
+		size_t ant_offset = 0;
+		size_t ant_count = 0;
+		size_t select_work_size = 1;
+
+		WanderAntFunctor advanceAntsCL;
+		SelectBestAntFunctor selectBestAntCL;
+		UpdatePheromoneFunctor updatePheromoneCL;
+
+		cl::Buffer pheromone_d;
+		cl::Buffer probabilities_d;
+		cl::Buffer visibility_d;
+		cl::Buffer weights_d;
+		cl::Buffer routes_d;
+		cl::Buffer routes_length_d;
+		cl::Buffer ant_sample_d;
+		cl::Buffer ant_allowed_d;
+		cl::Buffer allowed_template_d;
+		cl::Buffer rng_seeds_d;
+		cl::Buffer slice_best_d;
+		cl::Buffer slice_best_route_d;
+		cl::Buffer best_route_d;
+		cl::LocalSpaceArg reduce_length_d;
+		cl::LocalSpaceArg reduce_idx_d;
+
+		// Seeds of the slice's ants, the non-blocking upload reads them until the queue finished
+		std::vector<uint> rng_seeds;
+
+		// Gathered each round
+		cl_int best_length = std::numeric_limits<cl_int>::max();
+		std::vector<int> best_route;
+
+		DeviceSlice(const cl::Device& device)
+		:	device(device),
+			advanceAntsCL(cl::Kernel()),
+			selectBestAntCL(cl::Kernel()),
+			updatePheromoneCL(cl::Kernel()) {}
+	};
+
+	cl::Program program;
+	std::vector<DeviceSlice> slices;
+	std::vector<int> best_route;
+
+	cl_device_type device_type = CL_DEVICE_TYPE_GPU;
+	unsigned int subdevice_count = 0;
+
+	/*
+	Replaces the single device of setupCL by all matching devices (or their sub-devices) in one context
+	*/
+	void setupDevices() {
+		std::vector<cl::Platform> all_platforms;
+		cl::Platform::get(&all_platforms);
+		if (all_platforms.empty()) {
+			throw std::runtime_error("[OpenCL] No platforms found");
+		}
+
+		std::vector<cl::Device> devices;
+		all_platforms.at(0).getDevices(device_type, &devices);
+		if (devices.empty()) {
+			throw std::runtime_error("[OpenCL] No devices found.");
+		}
+
+		if (subdevice_count > 0) {
+			std::vector<cl::Device> subdevices;
+			for (cl::Device& parent : devices) {
+				// Exactly `subdevice_count` parts (fewer if there are not enough units), the remainder spread over the first ones
+				cl_uint units = parent.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+				cl_uint count = std::max(1U, std::min(units, subdevice_count));
+				std::vector<cl_device_partition_property> properties = { CL_DEVICE_PARTITION_BY_COUNTS };
+				for (cl_uint i = 0; i < count; i++) {
+					properties.push_back(static_cast<cl_device_partition_property>(units / count + (i < units % count ? 1 : 0)));
+				}
+				properties.push_back(CL_DEVICE_PARTITION_BY_COUNTS_LIST_END);
+				properties.push_back(0);
+				std::vector<cl::Device> parts;
+				cl_int succ = parent.createSubDevices(properties.data(), &parts);
+				if (succ != CL_SUCCESS || parts.empty()) {
+					throw std::runtime_error("[OpenCL] Could not split " + parent.getInfo<CL_DEVICE_NAME>()
+						+ " into " + std::to_string(count) + " sub-devices (" + std::to_string(succ) + ")");
+				}
+				subdevices.insert(subdevices.end(), parts.begin(), parts.end());
+			}
+			devices = subdevices;
+		}
+
+		context = cl::Context(devices);
+		// Every device holds its own replica, so their memory adds up
+		readMemoryLimits(devices);
+		for (const cl::Device& slice_device : devices) {
+			slices.emplace_back(slice_device);
+			slices.back().queue = cl::CommandQueue(context, slice_device, CL_QUEUE_PROFILING_ENABLE);
+		}
+		// Program build logs and the inherited helpers use the first device
+		device = slices.front().device;
+		queue = slices.front().queue;
+	}
+
+	/*
+	Ants are split by compute units, devices that would get no ant are dropped
+	*/
+	void splitAnts() {
+		size_t total_units = 0;
+		for (const DeviceSlice& slice : slices) {
+			total_units += slice.device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+		}
+
+		size_t units = 0;
+		size_t offset = 0;
+		for (DeviceSlice& slice : slices) {
+			units += slice.device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+			size_t end = total_units > 0 ? ant_count * units / total_units : ant_count;
+			slice.ant_offset = offset;
+			slice.ant_count = end - offset;
+			offset = end;
+		}
+		slices.back().ant_count += ant_count - offset;
+
+		slices.erase(std::remove_if(slices.begin(), slices.end(),
+			[](const DeviceSlice& slice) { return slice.ant_count == 0; }), slices.end());
+	}
+
+	void prepareSlice(DeviceSlice& slice, const Graph<double>& pheromone, const Graph<double>& visibility,
+	const Graph<double>& probabilities, const std::vector<int>& allowed_template, const std::vector<uint>& rngs) {
+		// The fill helpers enqueue on `queue`, so every replica is written by its own device
+		queue = slice.queue;
+
+		slice.pheromone_d = createAndFillBuffer("pheromone", problem.sizeSqr(), false, pheromone);
+		slice.probabilities_d = createAndFillBuffer("probabilities", problem.sizeSqr(), false, probabilities);
+		slice.visibility_d = createAndFillBuffer("visibility", problem.sizeSqr(), true, visibility);
+		slice.weights_d = createAndFillBuffer("weights", problem.sizeSqr(), true, problem.weights);
+		slice.routes_d = createAndFillBuffer<int>("routes", slice.ant_count * problem.size(), false, 0);
+		slice.routes_length_d = createAndFillBuffer("routes_length", slice.ant_count, false, std::numeric_limits<cl_int>::max());
+		slice.ant_sample_d = createBuffer<double>("ant_sample", slice.ant_count * problem.size(), false);
+		slice.ant_allowed_d = createBuffer<int>("ant_allowed", slice.ant_count * problem.size(), false);
+		slice.allowed_template_d = createAndFillBuffer("allowed_template", allowed_template.size(), true, allowed_template);
+
+		slice.rng_seeds.assign(rngs.begin() + slice.ant_offset, rngs.begin() + slice.ant_offset + slice.ant_count);
+		slice.rng_seeds_d = createAndFillBuffer("rng_seeds", slice.rng_seeds.size(), false, slice.rng_seeds);
+
+		slice.slice_best_d = createBuffer<int>("slice_best", 1, false);
+		slice.slice_best_route_d = createBuffer<int>("slice_best_route", problem.size(), false);
+		slice.best_route_d = createBuffer<int>("best_route", problem.size(), true);
+		slice.best_route.resize(problem.size());
+
+		slice.advanceAntsCL = WanderAntFunctor(cl::Kernel(program, "wander_ant"));
+		slice.selectBestAntCL = SelectBestAntFunctor(cl::Kernel(program, "select_best_ant"));
+		slice.updatePheromoneCL = UpdatePheromoneFunctor(cl::Kernel(program, "update_pheromone"));
+
+		// One work-group, the largest power of two not exceeding the slice or the device limit
+		size_t max_work_size = slice.selectBestAntCL.getKernel().getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(slice.device);
+		slice.select_work_size = 1;
+		while (slice.select_work_size * 2 <= std::min(slice.ant_count, max_work_size)) {
+			slice.select_work_size *= 2;
+		}
+		slice.reduce_length_d = createLocalBuffer<cl_int>(slice.select_work_size);
+		slice.reduce_idx_d = createLocalBuffer<cl_int>(slice.select_work_size);
+	}
+
+	/*
+	Constructs the slice's ants and enqueues the non-blocking gather of its best route
+	*/
+	void advanceSlice(DeviceSlice& slice, std::vector<cl::Event>& gathered) {
+		slice.advanceAntsCL(
+			cl::EnqueueArgs(slice.queue, cl::NDRange(slice.ant_count)),
+			slice.probabilities_d,
+			slice.weights_d,
+			slice.routes_d,
+			slice.routes_length_d,
+			slice.ant_sample_d,
+			slice.ant_allowed_d,
+			slice.allowed_template_d,
+			problem.size(),
+			slice.rng_seeds_d
+		);
+		slice.selectBestAntCL(
+			cl::EnqueueArgs(slice.queue, cl::NDRange(slice.select_work_size), cl::NDRange(slice.select_work_size)),
+			slice.routes_d,
+			slice.routes_length_d,
+			slice.slice_best_d,
+			slice.slice_best_route_d,
+			slice.reduce_length_d,
+			slice.reduce_idx_d,
+			slice.ant_count,
+			problem.size()
+		);
+
+		gathered.emplace_back();
+		slice.queue.enqueueReadBuffer(slice.slice_best_d, CL_FALSE, 0, sizeof(cl_int), &slice.best_length, nullptr, &gathered.back());
+		gathered.emplace_back();
+		slice.queue.enqueueReadBuffer(slice.slice_best_route_d, CL_FALSE, 0, sizeof(int) * problem.size(), slice.best_route.data(), nullptr, &gathered.back());
+		slice.queue.flush();
+	}
+
+	void updateSlice(DeviceSlice& slice, cl_int best_length) {
+		slice.queue.enqueueWriteBuffer(slice.best_route_d, CL_FALSE, 0, sizeof(int) * problem.size(), best_route.data());
+		slice.updatePheromoneCL(
+			cl::EnqueueArgs(slice.queue, cl::NDRange(problem.sizeSqr())),
+			slice.pheromone_d,
+			slice.probabilities_d,
+			slice.visibility_d,
+			params.alpha,
+			1 - params.rho,
+			params.min_pheromone,
+			params.max_pheromone,
+			slice.best_route_d,
+			best_length,
+			params.q,
+			problem.size()
+		);
+		slice.queue.flush();
+	}
+
+public:
+	static constexpr const char* static_name = "multidevice";
+	static constexpr const char* static_params = "type=<gpu|cpu|all>,subdevices=<count>";
+
+	MultiDeviceOptimizer(Problem problem, AntParams params)
+	:	CLColonyOptimizer::CLColonyOptimizer(problem, params),
+		pheromone(problem.size(), params.initial_pheromone) {
+		std::string type = params.variant_args.get<std::string>("type", "gpu");
+		if (type == "gpu") {
+			device_type = CL_DEVICE_TYPE_GPU;
+		}
+		else if (type == "cpu") {
+			device_type = CL_DEVICE_TYPE_CPU;
+		}
+		else if (type == "all") {
+			device_type = CL_DEVICE_TYPE_ALL;
+		}
+		else {
+			throw std::invalid_argument("Colony argument type must be gpu, cpu or all");
+		}
+		subdevice_count = params.variant_args.get<unsigned int>("subdevices", 0);
+
+		// Cached binaries are loaded for a single device, this program is built for all of them
+		this->params.kernel_cache_directory.clear();
+	}
+
+	Graph<double> pheromone;
+
+	/*
+	The ants are split across the devices, but every device updates its own replica
+	of the pheromone matrix, so the update traffic grows with the number of devices
+	*/
+	RoundCost roundCost() const override {
+		RoundCost cost = CLColonyOptimizer::roundCost();
+		const double devices = std::max<size_t>(1, slices.size());
+		cost.update.bytes *= devices;
+		cost.update.flops *= devices;
+		return cost;
+	}
+
+	void prepare() override {
+		setupDevices();
+		splitAnts();
+		program = loadProgramVariant(static_name, specializationArgs());
+
+		Graph<double> visibility = getVisibility();
+		Graph<double> probabilities(problem.size());
+		std::transform(pheromone.adjacency_matrix.data.cbegin(), pheromone.adjacency_matrix.data.cend(),
+			visibility.adjacency_matrix.data.cbegin(), probabilities.adjacency_matrix.data.begin(),
+			[this](const double& p, const double& v) { return std::pow(p, params.alpha) * v; });
+		std::vector<int> allowed_template = getAllowedList();
+		std::vector<uint> rngs = getRngs();
+
+		for (DeviceSlice& slice : slices) {
+			prepareSlice(slice, pheromone, visibility, probabilities, allowed_template, rngs);
+		}
+		for (DeviceSlice& slice : slices) {
+			slice.queue.finish();
+		}
+		queue = slices.front().queue;
+		best_route.resize(problem.size());
+	}
+
+	void optimize(unsigned int rounds) override {
+		while (rounds-- > 0) {
+			Profiler::start("opts");
+
+			Profiler::start("adva");
+			std::vector<cl::Event> gathered;
+			for (DeviceSlice& slice : slices) {
+				advanceSlice(slice, gathered);
+			}
+			cl::WaitForEvents(gathered);
+			Profiler::stop("adva");
+
+			Profiler::start("eval");
+			auto best_slice = std::min_element(slices.begin(), slices.end(),
+				[](const DeviceSlice& lhs, const DeviceSlice& rhs) { return lhs.best_length < rhs.best_length; });
+			best_route = best_slice->best_route;
+			cl_int best_length = best_slice->best_length;
+			best_route_length = std::min(best_route_length, static_cast<int>(best_length));
+			convergence.add(best_length);
+			Profiler::stop("eval");
+
+			Profiler::start("upda");
+			for (DeviceSlice& slice : slices) {
+				updateSlice(slice, best_length);
+			}
+			for (DeviceSlice& slice : slices) {
+				slice.queue.finish();
+			}
+			Profiler::stop("upda");
+
+			Profiler::stop("opts");
+		}
+	}
+};
@@ -0,0 +1,269 @@
+
+uint rng_minstd_rand0(uint* state) {
+	const uint a = 16807;
+	const uint m = 2147483647;
+	// Schrage's decomposition m = a * q + r keeps a * state % m within 32 bits
+	const uint q = 127773;
+	const uint r = 2836;
+
+	uint a_lo = a * (*state % q);
+	uint r_hi = r * (*state / q);
+	*state = a_lo >= r_hi ? a_lo - r_hi : a_lo + (m - r_hi);
+
+	return *state;
+}
+
+double rng_range(uint* state, double max) {
+	uint r = rng_minstd_rand0(state);
+	double dr = (double)r / 2147483647.0;
+	return dr * max;
+}
+
+// BITMASK_BITS is passed by the host to match the layout of the uploaded dependency masks
+#ifndef BITMASK_BITS
+#if defined(__opencl_c_int64) && !defined(FORCE_32BITMASK)
+#define BITMASK_BITS 64
+#else
+#define BITMASK_BITS 32
+#endif
+#endif
+
+#if BITMASK_BITS == 64
+typedef ulong bitmask;
+#else
+typedef uint bitmask;
+#endif
+const uint BITMASK_SIZE = BITMASK_BITS;
+
+inline void reset_bit(bitmask* mask, uint index) {
+	uint mask_idx = index / BITMASK_SIZE;
+	uint bit_idx = index % BITMASK_SIZE;
+
+	mask[mask_idx] &= ~(1UL << bit_idx);
+}
+
+inline void set_bit(bitmask* mask, uint index) {
+	uint mask_idx = index / BITMASK_SIZE;
+	uint bit_idx = index % BITMASK_SIZE;
+
+	mask[mask_idx] |= (1UL << bit_idx);
+}
+
+inline bool has_bit(const bitmask* mask, uint index) {
+	uint mask_idx = index / BITMASK_SIZE;
+	uint bit_idx = index % BITMASK_SIZE;
+
+	return (mask[mask_idx] & (1UL << bit_idx)) != 0;
+}
+
+#ifndef ANTS_PER_GROUP
+#define ANTS_PER_GROUP 1
+#endif
+
+/*
+	Several ants per work-group for small problems: ant `segment` of the group uses the lanes
+	[segment * segment_size, (segment + 1) * segment_size) and its own slice of local memory.
+	Segments are powers of two and aligned, so the Blelloch scan of each segment runs unchanged
+	in lock-step with the others.
+*/
+#ifdef WORK_SIZE
+__attribute__((reqd_work_group_size(WORK_SIZE, 1, 1)))
+#endif
+void kernel wander_ant(
+global const double* probabilities,
+global const int* weights,
+global const bitmask* dependencies,
+global int* ant_routes,
+global int* ant_route_length,
+local double* ant_sample,
+local int* ant_allowed,
+global const int* ant_allowed_template,
+int problem_size,
+int ant_count,
+global uint* rng_seeds) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+#ifdef SEGMENT_SIZE
+	const int segment_size = SEGMENT_SIZE;
+#else
+	const int segment_size = get_local_size(0) / ANTS_PER_GROUP;
+#endif
+	const int segment = get_local_id(0) / segment_size;
+	const int worker_idx = get_local_id(0) % segment_size;
+	const int ant_idx = get_group_id(0) * ANTS_PER_GROUP + segment;
+	const bool active_ant = ant_idx < ant_count;
+	const int ant_slot = min(ant_idx, ant_count - 1);
+	const bool is_node = worker_idx < problem_size;
+
+	int* ant_route = ant_routes + ant_slot * problem_size;
+	double* sample = ant_sample + segment * segment_size;
+	int* allowed = ant_allowed + segment * problem_size;
+	uint* seed = rng_seeds + ant_slot;
+#ifdef BITMASK_WORDS
+	const int bitmask_size = BITMASK_WORDS;
+#else
+	const int bitmask_size = problem_size / BITMASK_SIZE + (problem_size % BITMASK_SIZE != 0 ? 1 : 0);
+#endif
+
+	int route_length = 0;
+
+	const int worker_pwr = ctz(~worker_idx);
+	const int max_pwr = ctz(segment_size) + 1;
+	local int current_nodes[ANTS_PER_GROUP];
+	local double rngs[ANTS_PER_GROUP];
+	local int next_nodes[ANTS_PER_GROUP];
+	local int* current_node = current_nodes + segment;
+	local double* rng = rngs + segment;
+	local int* next_node = next_nodes + segment;
+	if (worker_idx == 0) {
+		*current_node = active_ant ? 0 : -1;
+		*rng = 0.0;
+		*next_node = -1;
+	}
+	if (is_node) {
+		allowed[worker_idx] = ant_allowed_template[worker_idx];
+	}
+	for (int i = 1; i < problem_size; i++) {
+		barrier(CLK_LOCAL_MEM_FENCE);
+		// Stuck or inactive ants keep scanning zeros, every lane has to reach every barrier
+		const bool ant_running = *current_node >= 0;
+		sample[worker_idx] = ant_running && is_node && allowed[worker_idx] == 0 ? probabilities[*current_node * problem_size + worker_idx] : 0;
+
+		// Up-Sweep
+		double my_sample = sample[worker_idx]; // Added at the end
+		for (int i = 0; i < max_pwr; i++) {
+			barrier(CLK_LOCAL_MEM_FENCE);
+			if (worker_pwr > i) {
+				int merge_idx = 1UL << i;
+				sample[worker_idx] += sample[worker_idx - merge_idx];
+			}
+		}
+
+		if (worker_idx == segment_size - 1) {
+			sample[worker_idx] = 0;
+		}
+
+		// Down-Sweep
+		for (int i = max_pwr - 1; i >= 0; i--) {
+			barrier(CLK_LOCAL_MEM_FENCE);
+			if (worker_pwr > i) {
+				int merge_idx = 1UL << i;
+				double curr = sample[worker_idx];
+				sample[worker_idx] += sample[worker_idx - merge_idx];
+				sample[worker_idx - merge_idx] = curr;	
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		sample[worker_idx] += my_sample; // Make exclusive scan into inclusive one
+
+		if (ant_running && worker_idx == problem_size - 1) {
+			*rng = rng_range(seed, sample[worker_idx]);
+			*next_node = -1;
+		}
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+		bool in_self_range = 
+			ant_running
+			&& is_node
+			&& *rng < sample[worker_idx]
+			&& (worker_idx == 0 || *rng >= sample[worker_idx - 1]);
+		if (in_self_range) {
+			*next_node = worker_idx;
+		}
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (ant_running && worker_idx == 0) {
+			if (*next_node < 0) {
+				*current_node = -1;
+			}
+			else {
+				route_length += weights[*current_node * problem_size + *next_node];
+
+				*current_node = *next_node;
+				ant_route[i] = *next_node;
+				allowed[*next_node] = -1;
+			}
+		}
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (*current_node >= 0 && is_node) {
+			const bitmask* dep_mask = dependencies + *current_node * bitmask_size;
+			if (has_bit(dep_mask, worker_idx)) {
+				// node `worker_idx` depends on current_node => Update allowed entry
+				allowed[worker_idx] -= 1;
+			}
+		}
+	}
+
+	if (active_ant && worker_idx == 0) {
+		ant_route_length[ant_idx] = (*current_node == problem_size - 1) ? route_length : INT_MAX;
+	}
+}
+
+
+void kernel update_pheromone(
+global double* pheromone,
+global double* probabilities,
+global double* visibility,
+double alpha,
+double one_minus_roh,
+double min_pheromone,
+double max_pheromone,
+global const int* ant_routes,
+global const int* best_ant,
+double q,
+int problem_size
+) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	const int best_ant_idx = best_ant[0];
+	const double best_ant_pheromone = q / best_ant[1];
+	int edge = get_global_id(0);
+	int from = edge / problem_size;
+	int to = edge % problem_size;
+	const int* best_ant_route = ant_routes + best_ant_idx * problem_size;
+
+	// Evaporate
+	pheromone[edge] *= one_minus_roh;
+
+	// Lay along best_ant
+	//? Could be "optimized" by looping one short, thereby removing the check for i+1 to be a valid index
+
+	//? Could also be made obsolete if a bitmask exists, containing each edge and whether it is part of the best_route (1) or not (0)
+
+	//? How about a list of each node containing the next node in the route
+	//? This would require reimagining the meaning of ant_route but nothing more
+	//? Because each node MUST occure in the route, there are as many entries as there are nodes
+	//? Currently, ant_route[index] is the node where ant was at step no #index
+	//? But ant_route[index] could also be interpreted as the next node that was chosen while standing at node "index"
+	//? No information would be lost (although retrieving the step-by-step best route would be slightly more complex)
+	//? But the following algorithm would be made possible
+	/*
+	? next_arr[problem_size]
+	? if next_arr[from] == to {
+	? 	pheromone[edge] += best_ant_pheromone
+	? }
+	*/
+	for (int i = 0; i < problem_size; i++) {
+		if (best_ant_route[i] != from) {
+			continue;
+		}
+
+		if (i + 1 >= problem_size) {
+			 continue;
+		}
+
+		if (best_ant_route[i + 1] != to) {
+			continue;
+		}
+
+		pheromone[edge] += best_ant_pheromone;
+	}
+
+	pheromone[edge] = clamp(pheromone[edge], min_pheromone, max_pheromone);
+
+	probabilities[edge] = powr(pheromone[edge], alpha) * visibility[edge];
+}
+
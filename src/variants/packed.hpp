@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <random>
+#include <bitset>
+#include <type_traits>
+
+#include "clcolony.hpp"
+#include "../profiler.hpp"
+
+/*
+	localant with several ants per work-group, so small problems do not leave most lanes of a group idle.
+	Colony argument group_ants: ants per work-group (default: as many as fit into 256 lanes)
+*/
+class PackedOptimizer: public CLColonyOptimizer {
+protected:
+	cl::Program program;
+	cl::KernelFunctor<
+		cl::Buffer, // probabilities
+		cl::Buffer, // weights
+		cl::Buffer, // dependencies
+		cl::Buffer, // ant_routes
+		cl::Buffer, // ant_routes_length
+		cl::LocalSpaceArg, // ant_sample
+		cl::LocalSpaceArg, // ant_allowed
+		cl::Buffer, // ant_allowed_template
+		cl_int,     // problem_size
+		cl_int,     // ant_count
+		cl::Buffer  // rng_seeds
+	> advanceAntsCL;
+
+	cl::KernelFunctor<
+		cl::Buffer, // pheromone
+		cl::Buffer, // probabilities
+		cl::Buffer, // visibility
+		cl_double, // alpha
+		cl_double, // one_minus_roh
+		cl_double, // min_pheromone
+		cl_double, // max_pheromone
+		cl::Buffer, // ant_routes
+		cl::Buffer, // best_ant
+		cl_double, // q
+		cl_int  // problem_size
+	> updatePheromoneCL;
+
+	cl::Buffer pheromone_d;
+	cl::Buffer visibility_d;
+	cl::Buffer weights_d;
+	cl::Buffer routes_d;
+	cl::Buffer routes_length_d;
+	cl::LocalSpaceArg ant_sample_d;
+	cl::LocalSpaceArg ant_allowed_d;
+	cl::Buffer ant_allowed_template_d;
+	cl::Buffer rng_seeds_d;
+	cl::Buffer probabilities_d;
+	cl::Buffer dependencies_d;
+
+	size_t work_size = 0;
+	size_t segment_size = 0;
+	size_t ants_per_group = 0;
+	size_t group_count = 0;
+
+	size_t leftmost_one(size_t value) {
+		int i = 0;
+		for (; i < sizeof(size_t) * 8; i++) {
+			if (value >> i == 0) { return i; }
+		}
+		return i;
+	}
+
+	/*
+	Every ant gets a segment of the next power of two lanes; segments are packed until the group
+	reaches `target_work_size`, or the limits of the device and the kernel on work-group size and local memory.
+	Throws if not even a single segment fits, those problems need "tiled".
+	*/
+	void choosePacking(size_t requested_ants_per_group) {
+		const size_t target_work_size = 256;
+		// Only a build without the fixed size reports the limit of the kernel itself
+		cl::Kernel unsized(loadProgramVariant(static_name, specializationArgs()), "wander_ant");
+		const size_t max_work_size = std::min<size_t>(
+			device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>(),
+			unsized.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		const size_t local_mem_size = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+
+		segment_size = 1UL << leftmost_one(problem.size() - 1);
+		// sample, allowed and the per-ant current_node, rng and next_node
+		const size_t ant_local_mem = segment_size * sizeof(cl_double) + problem.size() * sizeof(cl_int) + 16;
+		if (segment_size > max_work_size || ant_local_mem > local_mem_size) {
+			throw std::runtime_error("[OpenCL] packed: one ant needs " + std::to_string(segment_size) + " work-items and "
+				+ std::to_string(ant_local_mem) + " bytes of local memory, the device allows " + std::to_string(max_work_size)
+				+ " and " + std::to_string(local_mem_size) + ". Use \"tiled\" for problems of this size");
+		}
+		ants_per_group = requested_ants_per_group > 0 ? requested_ants_per_group : std::max<size_t>(1, target_work_size / segment_size);
+		ants_per_group = std::min(ants_per_group, ant_count);
+		while (ants_per_group > 1 && (ants_per_group * segment_size > max_work_size || ants_per_group * ant_local_mem > local_mem_size)) {
+			ants_per_group--;
+		}
+		work_size = ants_per_group * segment_size;
+		group_count = ant_count / ants_per_group + (ant_count % ants_per_group != 0 ? 1 : 0);
+	}
+
+	StageEvents advanceAnts(const StageEvents& wait_for) {
+		cl::NDRange global_size(work_size * group_count);
+		cl::NDRange local_size(work_size);
+		return { advanceAntsCL(
+			cl::EnqueueArgs(queue, wait_for, global_size, local_size),
+			probabilities_d,
+			weights_d,
+			dependencies_d,
+			routes_d,
+			routes_length_d,
+			ant_sample_d,
+			ant_allowed_d,
+			ant_allowed_template_d,
+			problem.size(),
+			ant_count,
+			rng_seeds_d			
+		) };
+	}
+
+	StageEvents updatePheromone(const StageEvents& wait_for, double q) {
+		cl::NDRange global_size(problem.size() * problem.size());
+		return { updatePheromoneCL(
+			cl::EnqueueArgs(queue, wait_for, global_size),
+			pheromone_d,
+			probabilities_d,
+			visibility_d,
+			params.alpha,
+			1 - params.rho,
+			params.min_pheromone,
+			params.max_pheromone,
+			routes_d,
+			best_ant_d,
+			q,
+			problem.size()
+		) };
+	}
+
+public:
+	static constexpr const char* static_name = "packed";
+	static constexpr const char* static_params = "group_ants=<ants per work-group>";
+
+	PackedOptimizer(Problem problem, AntParams params)
+	:	CLColonyOptimizer::CLColonyOptimizer(problem, params),
+		advanceAntsCL(cl::Kernel()),
+		updatePheromoneCL(cl::Kernel()),
+		pheromone(problem.size(), params.initial_pheromone) {}
+
+	Graph<double> pheromone;
+
+	/*
+	Samples and allowed counters stay in local memory, only the probabilities row
+	and the dependency bits of the chosen node go through global memory
+	*/
+	RoundCost roundCost() const override {
+		RoundCost cost = CLColonyOptimizer::roundCost();
+		const double n = problem.size();
+		const double steps = ant_count * (n - 1);
+		cost.advance.bytes = steps * (n * sizeof(double) + n / 8);
+		return cost;
+	}
+
+	void prepare() override {
+		setupCL(false);
+		choosePacking(params.variant_args.get<size_t>("group_ants", 0));
+		std::string packing_args = 
+			" -DANTS_PER_GROUP=" + std::to_string(ants_per_group) +
+			" -DSEGMENT_SIZE=" + std::to_string(segment_size);
+		program = loadProgramVariant(static_name, specializationArgs(work_size) + packing_args);
+
+		pheromone_d = createAndFillBuffer("pheromone", problem.sizeSqr(), false, pheromone);
+		weights_d = wrapHostBuffer("weights", problem.weights);
+		routes_d = createAndFillBuffer<int>("routes", ant_count * problem.size(), false, 0);
+		routes_length_d = createAndFillBuffer("routes_length", ant_count, false, std::numeric_limits<cl_int>::max());
+		probabilities_d = createAndFillBuffer<double>("probabilities", problem.sizeSqr(), false, 0.0);
+		ant_sample_d = createLocalBuffer<double>(work_size);
+		ant_allowed_d = createLocalBuffer<int>(ants_per_group * problem.size());
+
+		dependencies_d = createDependencyBuffer(false);
+
+		visibility_d = createVisibilityBuffer();
+
+		std::vector<int> allowed_data = getAllowedList();
+		ant_allowed_template_d = createAndFillBuffer("ant_allowed_template", allowed_data.size(), true, allowed_data);
+
+		std::vector<uint> rngs = getRngs();
+		rng_seeds_d = createAndFillBuffer("rng_seeds", rngs.size(), false, rngs);
+
+		setupBestAnt();
+		queue.finish();
+
+		advanceAntsCL = decltype(advanceAntsCL)(cl::Kernel(program, "wander_ant"));
+		updatePheromoneCL = decltype(updatePheromoneCL)(cl::Kernel(program, "update_pheromone"));
+
+		updatePheromone({}, 0);
+		queue.finish();
+	}
+
+	void optimize(unsigned int rounds) override {
+		runPipeline(rounds, routes_length_d,
+			[this](const StageEvents& wait_for) { return advanceAnts(wait_for); },
+			[this](const StageEvents& wait_for) { return updatePheromone(wait_for, params.q); });
+	}
+};
+
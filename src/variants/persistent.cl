@@ -0,0 +1,194 @@
+
+uint rng_minstd_rand0(global uint* state) {
+	const uint a = 16807;
+	const uint m = 2147483647;
+	// Schrage's decomposition m = a * q + r keeps a * state % m within 32 bits
+	const uint q = 127773;
+	const uint r = 2836;
+
+	uint a_lo = a * (*state % q);
+	uint r_hi = r * (*state / q);
+	*state = a_lo >= r_hi ? a_lo - r_hi : a_lo + (m - r_hi);
+
+	return *state;
+}
+
+double rng_range(global uint* state, double max) {
+	uint r = rng_minstd_rand0(state);
+	double dr = (double)r / 2147483647.0;
+	return dr * max;
+}
+
+void construct_route(
+global const double* probabilities,
+global const int* weights,
+global int* ant_route,
+global int* route_length,
+global double* sample,
+global int* allowed,
+global const int* allowed_template,
+int problem_size,
+global uint* seed) {
+	for (int i = 0; i < problem_size; i++) {
+		allowed[i] = allowed_template[i];
+	}
+
+	int current_node = 0;
+	*route_length = 0;
+	for (int i = 1; i < problem_size; i++) {
+		double sample_sum = 0.0;
+		bool hasPossibleNext = false;
+		for (int next = 0; next < problem_size; next++) {
+			if (allowed[next] != 0) {
+				sample[next] = 0.0;
+				continue;
+			}
+			double edge_value = probabilities[current_node * problem_size + next];
+			sample[next] = edge_value;
+			sample_sum += edge_value;
+
+			hasPossibleNext = true;
+		}
+
+		if (!hasPossibleNext) {
+			current_node = -1;
+			break;
+		}
+
+		double rng = rng_range(seed, sample_sum);
+		int next_node = -1;
+		for (int n = 0; n < problem_size; n++) {
+			rng -= sample[n];
+			if (rng < 0) {
+				next_node = n;
+				break;
+			}
+		}
+		if (next_node < 0) {
+			current_node = -1;
+			break;
+		}
+
+		*route_length += weights[current_node * problem_size + next_node];
+
+		current_node = next_node;
+		ant_route[i] = next_node;
+		allowed[next_node] = -1;
+
+		for (int n = 0; n < problem_size; n++) {
+			if (weights[n * problem_size + next_node] == -1) {
+				allowed[n] -= 1;
+			}
+		}
+	}
+
+	if (current_node != problem_size - 1) {
+		*route_length = INT_MAX;
+	}
+}
+
+/*
+	Runs `rounds` complete optimization rounds in a single work-group.
+	Work-items take the `ant_count` ants in strides of the work-group size, phases are separated by work-group barriers.
+	best_ant[0]: Index of the best ant of the last round
+	best_ant[1]: Route length of the best ant of the last round
+	best_ant[2]: Shortest route length found so far
+*/
+#ifdef WORK_SIZE
+__attribute__((reqd_work_group_size(WORK_SIZE, 1, 1)))
+#endif
+void kernel run_rounds(
+global double* pheromone,
+global double* probabilities,
+global const double* visibility,
+global const int* weights,
+global int* ant_routes,
+global int* ant_route_length,
+global double* ant_sample,
+global int* ant_allowed,
+global const int* allowed_template,
+global int* best_ant,
+local int* reduce_length,
+local int* reduce_idx,
+double alpha,
+double one_minus_roh,
+double min_pheromone,
+double max_pheromone,
+double q,
+int rounds,
+int problem_size,
+int ant_count,
+global uint* rng_seeds) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	const int lid = get_local_id(0);
+	const int worker_size = get_local_size(0);
+	const int edge_count = problem_size * problem_size;
+
+	for (int round = 0; round < rounds; round++) {
+		// Construct
+		for (int ant_idx = lid; ant_idx < ant_count; ant_idx += worker_size) {
+			construct_route(
+				probabilities,
+				weights,
+				ant_routes + ant_idx * problem_size,
+				ant_route_length + ant_idx,
+				ant_sample + ant_idx * problem_size,
+				ant_allowed + ant_idx * problem_size,
+				allowed_template,
+				problem_size,
+				rng_seeds + ant_idx);
+		}
+		barrier(CLK_GLOBAL_MEM_FENCE);
+
+		// Best ant, ties go to the lower index like the serial search
+		int own_length = INT_MAX;
+		int own_idx = 0;
+		for (int ant_idx = lid; ant_idx < ant_count; ant_idx += worker_size) {
+			if (ant_route_length[ant_idx] < own_length) {
+				own_length = ant_route_length[ant_idx];
+				own_idx = ant_idx;
+			}
+		}
+		reduce_length[lid] = own_length;
+		reduce_idx[lid] = own_idx;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		for (int stride = worker_size / 2; stride > 0; stride /= 2) {
+			if (lid < stride && (reduce_length[lid + stride] < reduce_length[lid]
+				|| (reduce_length[lid + stride] == reduce_length[lid] && reduce_idx[lid + stride] < reduce_idx[lid]))) {
+				reduce_length[lid] = reduce_length[lid + stride];
+				reduce_idx[lid] = reduce_idx[lid + stride];
+			}
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+		const int best_len = reduce_length[0];
+		const int best_idx = reduce_idx[0];
+		if (lid == 0) {
+			best_ant[0] = best_idx;
+			best_ant[1] = best_len;
+			best_ant[2] = min(best_ant[2], best_len);
+		}
+
+		// Evaporate
+		for (int edge = lid; edge < edge_count; edge += worker_size) {
+			pheromone[edge] *= one_minus_roh;
+		}
+		barrier(CLK_GLOBAL_MEM_FENCE);
+
+		// Lay along best ant, every edge of a route is distinct
+		const global int* best_route = ant_routes + best_idx * problem_size;
+		const double best_ant_pheromone = q / best_len;
+		for (int i = lid; i + 1 < problem_size; i += worker_size) {
+			pheromone[best_route[i] * problem_size + best_route[i + 1]] += best_ant_pheromone;
+		}
+		barrier(CLK_GLOBAL_MEM_FENCE);
+
+		// Refresh probabilities
+		for (int edge = lid; edge < edge_count; edge += worker_size) {
+			pheromone[edge] = clamp(pheromone[edge], min_pheromone, max_pheromone);
+			probabilities[edge] = powr(pheromone[edge], alpha) * visibility[edge];
+		}
+		barrier(CLK_GLOBAL_MEM_FENCE);
+	}
+}
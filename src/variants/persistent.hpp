@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <random>
+
+#include "clcolony.hpp"
+#include "../profiler.hpp"
+
+/*
+	Runs several complete rounds per kernel launch in a single work-group,
+	so small problems are not dominated by the launch latency of three kernels per round.
+	Colony argument rounds: rounds per launch (default 16)
+*/
+class PersistentOptimizer: public CLColonyOptimizer {
+protected:
+	cl::Program program;
+	cl::KernelFunctor<
+		cl::Buffer, // pheromone
+		cl::Buffer, // probabilities
+		cl::Buffer, // visibility
+		cl::Buffer, // weights
+		cl::Buffer, // ant_routes
+		cl::Buffer, // ant_routes_length
+		cl::Buffer, // ant_sample
+		cl::Buffer, // ant_allowed
+		cl::Buffer, // allowed_template
+		cl::Buffer, // best_ant
+		cl::LocalSpaceArg, // reduce_length
+		cl::LocalSpaceArg, // reduce_idx
+		cl_double, // alpha
+		cl_double, // one_minus_roh
+		cl_double, // min_pheromone
+		cl_double, // max_pheromone
+		cl_double, // q
+		cl_int,    // rounds
+		cl_int,    // problem_size
+		cl_int,    // ant_count
+		cl::Buffer // rng_seeds
+	> runRoundsCL;
+
+	cl::Buffer pheromone_d;
+	cl::Buffer probabilities_d;
+	cl::Buffer visibility_d;
+	cl::Buffer weights_d;
+	cl::Buffer routes_d;
+	cl::Buffer routes_length_d;
+	cl::Buffer ant_sample_d;
+	cl::Buffer ant_allowed_d;
+	cl::Buffer allowed_template_d;
+	cl::Buffer rng_seeds_d;
+	cl::LocalSpaceArg reduce_length_d;
+	cl::LocalSpaceArg reduce_idx_d;
+
+	size_t work_size = 0;
+
+	size_t leftmost_one(size_t value) {
+		int i = 0;
+		for (; i < sizeof(size_t) * 8; i++) {
+			if (value >> i == 0) { return i; }
+		}
+		return i;
+	}
+
+	cl::Event runRounds(unsigned int rounds) {
+		cl::NDRange global_size(work_size);
+		cl::NDRange local_size(work_size);
+		return runRoundsCL(
+			cl::EnqueueArgs(queue, global_size, local_size),
+			pheromone_d,
+			probabilities_d,
+			visibility_d,
+			weights_d,
+			routes_d,
+			routes_length_d,
+			ant_sample_d,
+			ant_allowed_d,
+			allowed_template_d,
+			best_ant_d,
+			reduce_length_d,
+			reduce_idx_d,
+			params.alpha,
+			1 - params.rho,
+			params.min_pheromone,
+			params.max_pheromone,
+			params.q,
+			rounds,
+			problem.size(),
+			ant_count,
+			rng_seeds_d
+		);
+	}
+
+	/*
+	Waits for all pending launches and hands their times to the profiler.
+	A launch covering k rounds counts as k rounds of a k-th of its duration each.
+	*/
+	void checkpointLaunches(std::vector<std::pair<cl::Event, unsigned int>>& pending) {
+		cl_int best_ant[3];
+		readBuffer(best_ant_d, 0, 3, best_ant);
+		best_route_length = std::min(best_route_length, static_cast<int>(best_ant[2]));
+
+		std::vector<cl::Event> launch_end;
+		std::vector<unsigned int> launch_round_count;
+		for (const auto& [launch, launch_rounds] : pending) {
+			launch_end.push_back(launch);
+			launch_round_count.push_back(launch_rounds);
+		}
+		readConvergence(queue, launch_end, launch_round_count);
+
+		for (const auto& [launch, launch_rounds] : pending) {
+			Profiler::Duration duration = eventDuration(launch, launch);
+			Profiler::record("lnch", duration);
+			traceStage("lnch", { launch }, 0);
+			for (unsigned int i = 0; i < launch_rounds; i++) {
+				Profiler::record("opts", duration / launch_rounds);
+			}
+		}
+		pending.clear();
+	}
+
+public:
+	static constexpr const char* static_name = "persistent";
+	static constexpr const char* static_params = "rounds=<per launch>";
+
+	PersistentOptimizer(Problem problem, AntParams params)
+	:	CLColonyOptimizer::CLColonyOptimizer(problem, params),
+		runRoundsCL(cl::Kernel()),
+		pheromone(problem.size(), params.initial_pheromone) {
+		rounds_per_launch = params.variant_args.get<unsigned int>("rounds", 16);
+		if (rounds_per_launch == 0) {
+			throw std::invalid_argument("persistent: rounds per launch must be at least 1");
+		}
+	}
+
+	Graph<double> pheromone;
+
+	/*
+	Construction matches the basic kernel. The update rereads the pheromone
+	after evaporation and writes it again after clamping
+	*/
+	RoundCost roundCost() const override {
+		RoundCost cost = CLColonyOptimizer::roundCost();
+		const double n = problem.size();
+		// Evaporation read and written, clamp read and written, visibility read, probabilities written
+		cost.update.bytes = n * n * 6 * sizeof(double);
+		return cost;
+	}
+
+	void prepare() override {
+		setupCL(false);
+		// One work-item per ant as far as the device allows, the remaining ants are taken in strides
+		work_size = ant_count > 1 ? 1UL << leftmost_one(ant_count - 1) : 1;
+		work_size = std::min<size_t>(work_size, device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>());
+
+		// The fused kernel usually allows less than the device, which only a build without the fixed size reports
+		cl::Program unsized = loadProgramVariant(static_name, specializationArgs());
+		size_t kernel_work_size = cl::Kernel(unsized, "run_rounds").getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+		while (work_size > 1 && work_size > kernel_work_size) {
+			work_size /= 2;
+		}
+		program = loadProgramVariant(static_name, specializationArgs(work_size));
+
+		visibility_d = createVisibilityBuffer();
+		Graph<double> probabilities(problem.size());
+		std::transform(pheromone.adjacency_matrix.data.cbegin(), pheromone.adjacency_matrix.data.cend(),
+			visibility_host.adjacency_matrix.data.cbegin(), probabilities.adjacency_matrix.data.begin(),
+			[this](const double& p, const double& v) { return std::pow(p, params.alpha) * v; });
+
+		pheromone_d = createAndFillBuffer("pheromone", problem.sizeSqr(), false, pheromone);
+		probabilities_d = createAndFillBuffer("probabilities", problem.sizeSqr(), false, probabilities);
+		weights_d = wrapHostBuffer("weights", problem.weights);
+		routes_d = createAndFillBuffer<int>("routes", ant_count * problem.size(), false, 0);
+		routes_length_d = createAndFillBuffer("routes_length", ant_count, false, std::numeric_limits<cl_int>::max());
+		ant_sample_d = createBuffer<double>("ant_sample", ant_count * problem.size(), false);
+		ant_allowed_d = createBuffer<int>("ant_allowed", ant_count * problem.size(), false);
+		reduce_length_d = createLocalBuffer<int>(work_size);
+		reduce_idx_d = createLocalBuffer<int>(work_size);
+
+		std::vector<int> allowed_template = getAllowedList();
+		allowed_template_d = createAndFillBuffer("allowed_template", allowed_template.size(), true, allowed_template);
+
+		std::vector<uint> rngs = getRngs();
+		rng_seeds_d = createAndFillBuffer("rng_seeds", rngs.size(), false, rngs);
+
+		std::vector<cl_int> best_ant = { 0, std::numeric_limits<cl_int>::max(), std::numeric_limits<cl_int>::max() };
+		best_ant_d = createAndFillBuffer("best_ant", best_ant.size(), false, best_ant);
+		setupConvergence();
+
+		queue.finish();
+
+		runRoundsCL = decltype(runRoundsCL)(cl::Kernel(program, "run_rounds"));
+	}
+
+	void optimize(unsigned int rounds) override {
+		std::vector<std::pair<cl::Event, unsigned int>> pending;
+		while (rounds > 0) {
+			unsigned int launch_rounds = std::min(rounds, rounds_per_launch);
+			StageEvents launch = { runRounds(launch_rounds) };
+			logIterationBest(queue, pending.size(), launch);
+			pending.emplace_back(launch.front(), launch_rounds);
+			rounds -= launch_rounds;
+
+			if (pending.size() >= checkpoint_interval || rounds == 0) {
+				checkpointLaunches(pending);
+			}
+		}
+	}
+};
@@ -13,14 +13,17 @@ public:
 		int route_length = 0;
 
 		struct minstd0_engine {
+			static constexpr uint32_t modulus = 2147483647;
+
 			u_int32_t state;
 
+			/*
+			@return Next state in [0, modulus), the product is taken in 64 bits like std::minstd_rand0
+			*/
 			uint32_t operator()() {
-				const uint a = 16807;
-				const uint c = 0;
-				const uint m = 2147483647;
+				const uint64_t a = 16807;
 
-				state = (a * (state) + c) % m;
+				state = (a * state) % modulus;
 
 				return state;
 			}
@@ -38,13 +41,30 @@ public:
 
 	using AntOptimizer::AntOptimizer;
 
+	/*
+	Candidates compute pheromone^alpha * visibility on the fly instead of reading probabilities,
+	the update only evaporates and clamps the pheromone
+	*/
+	RoundCost roundCost() const override {
+		RoundCost cost = AntOptimizer::roundCost();
+		const double n = problem.size();
+		const double steps = ant_count * (n - 1);
+		// pheromone, visibility, candidate weights written and reread, allowed counters, dependencies
+		cost.advance.bytes = steps * n * (2 * sizeof(double) + 2 * sizeof(double) + sizeof(int) + sizeof(bool));
+		// pow, multiplication, sum and roulette per candidate
+		cost.advance.flops = steps * 4 * n;
+		cost.update.bytes = n * n * 2 * sizeof(double);
+		cost.update.flops = n * n + (n - 1);
+		return cost;
+	}
+
 	Graph<double> pheromone;
 	Graph<double> visibility;
 
 	Ant prototype_ant;
 	std::minstd_rand0 random_generator;
 
-	SequentialOptimizer(Problem problem, AntParams params)
+	SequentialOptimizer(const Problem& problem, AntParams params)
 	:	AntOptimizer::AntOptimizer(problem, params),
 		pheromone(problem.size(), params.initial_pheromone),
 		visibility(problem.size()) {}
@@ -81,13 +101,18 @@ public:
 		}
 
 		random_generator.seed(params.random_seed);
+
+		host_memory.add("pheromone", sizeof(double) * pheromone.adjacency_matrix.data.size());
+		host_memory.add("visibility", sizeof(double) * visibility.adjacency_matrix.data.size());
 	}
 
 	void optimize(unsigned int rounds) override {
-		std::vector<Ant> ants(problem.size());
+		std::vector<Ant> ants(ant_count);
 		for (Ant& ant : ants) {
 			ant.random_generator.seed(random_generator());
 		}
+		// Allowed nodes and route of every ant, at most one entry per node each
+		host_memory.add("ants", ant_count * (sizeof(Ant) + 2 * sizeof(int) * problem.size()));
 		while (rounds-- > 0) {
 			Profiler::start("opts");
 
@@ -126,6 +151,7 @@ public:
 					best_ant = &ant;
 				}	
 			}
+			convergence.add(best_ant->route_length);
 			Profiler::stop("eval");
 
 			Profiler::start("upda");
@@ -147,22 +173,30 @@ public:
 			for (auto& value : pheromone.adjacency_matrix.data) {
 				value = std::clamp(value, params.min_pheromone, params.max_pheromone);
 			}
+			pheromoneUpdated();
 			Profiler::stop("upda");
 
 			Profiler::stop("opts");
 		}
 	}
 
-private:
+protected:
+	/*
+	Called after every update, for state derived from the pheromone
+	*/
+	virtual void pheromoneUpdated() {}
+
 	double edge_value(size_t from, size_t to) {
 		double pher = pheromone.edge(from, to);
 		double vis = visibility.edge(from, to);
 		return std::pow(pher, params.alpha) * vis;
 	}
 
-	void advance_ant(Ant& ant) {
-		if (ant.current_node < 0) { return; }
-
+	/*
+	Draws the next node of `ant` by roulette over the allowed edges
+	@return The chosen node, -1 if the ant is stuck
+	*/
+	virtual int choose_next(Ant& ant) {
 		bool hasPossibleNext = false;
 		std::vector<double> next_nodes(problem.size(), 0.0);
 		double sum = 0.0;
@@ -175,12 +209,11 @@ private:
 		}
 
 		if (!hasPossibleNext) {
-			ant.current_node = -1;
-			return;
+			return -1;
 		}
 
 		int next_node = -1;
-		double rd = (static_cast<double>(ant.random_generator()) / UINT32_MAX) * sum;
+		double rd = (static_cast<double>(ant.random_generator()) / Ant::minstd0_engine::modulus) * sum;
 		for (size_t i = 0; i < next_nodes.size(); i++) {
 			rd -= next_nodes[i];
 			if (rd < 0) {
@@ -191,6 +224,13 @@ private:
 
 		//std::discrete_distribution<size_t> dist(next_nodes.begin(), next_nodes.end());
 		//size_t next_node = dist(ant.random_generator);
+		return next_node;
+	}
+
+	void advance_ant(Ant& ant) {
+		if (ant.current_node < 0) { return; }
+
+		int next_node = choose_next(ant);
 		if (next_node == -1) {
 			ant.current_node = -1;
 			return;
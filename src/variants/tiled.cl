@@ -0,0 +1,292 @@
+
+uint rng_minstd_rand0(uint* state) {
+	const uint a = 16807;
+	const uint m = 2147483647;
+	// Schrage's decomposition m = a * q + r keeps a * state % m within 32 bits
+	const uint q = 127773;
+	const uint r = 2836;
+
+	uint a_lo = a * (*state % q);
+	uint r_hi = r * (*state / q);
+	*state = a_lo >= r_hi ? a_lo - r_hi : a_lo + (m - r_hi);
+
+	return *state;
+}
+
+double rng_range(uint* state, double max) {
+	uint r = rng_minstd_rand0(state);
+	double dr = (double)r / 2147483647.0;
+	return dr * max;
+}
+
+// BITMASK_BITS is passed by the host to match the layout of the uploaded dependency masks
+#ifndef BITMASK_BITS
+#if defined(__opencl_c_int64) && !defined(FORCE_32BITMASK)
+#define BITMASK_BITS 64
+#else
+#define BITMASK_BITS 32
+#endif
+#endif
+
+#if BITMASK_BITS == 64
+typedef ulong bitmask;
+#else
+typedef uint bitmask;
+#endif
+const uint BITMASK_SIZE = BITMASK_BITS;
+
+inline void reset_bit(bitmask* mask, uint index) {
+	uint mask_idx = index / BITMASK_SIZE;
+	uint bit_idx = index % BITMASK_SIZE;
+
+	mask[mask_idx] &= ~(1UL << bit_idx);
+}
+
+inline void set_bit(bitmask* mask, uint index) {
+	uint mask_idx = index / BITMASK_SIZE;
+	uint bit_idx = index % BITMASK_SIZE;
+
+	mask[mask_idx] |= (1UL << bit_idx);
+}
+
+inline bool has_bit(const bitmask* mask, uint index) {
+	uint mask_idx = index / BITMASK_SIZE;
+	uint bit_idx = index % BITMASK_SIZE;
+
+	return (mask[mask_idx] & (1UL << bit_idx)) != 0;
+}
+
+#ifndef TILE
+#define TILE 1
+#endif
+
+/*
+	Work-group per ant for problems wider than a work-group: every work-item owns TILE nodes,
+	node = worker_idx + t * worker_size, so accesses of neighbouring work-items stay coalesced.
+	The scan runs over the per-work-item tile totals; only the work-item whose range holds
+	the random value walks its tile again to find the node.
+	With ALLOWED_GLOBAL the allowed counters do not fit into local memory and live in `ant_allowed_global`.
+*/
+#ifdef WORK_SIZE
+__attribute__((reqd_work_group_size(WORK_SIZE, 1, 1)))
+#endif
+void kernel wander_ant(
+global const double* probabilities,
+global const int* weights,
+global const bitmask* dependencies,
+global int* ant_routes,
+global int* ant_route_length,
+local double* ant_sample,
+local int* ant_allowed,
+global int* ant_allowed_global,
+global const int* ant_allowed_template,
+int problem_size,
+global uint* rng_seeds) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	int ant_idx = get_group_id(1);
+	int worker_idx = get_local_id(0);
+#ifdef WORK_SIZE
+	const int worker_size = WORK_SIZE;
+#else
+	int worker_size = get_local_size(0);
+#endif
+
+	int* ant_route = ant_routes + ant_idx * problem_size;
+	double* sample = ant_sample;
+#ifdef ALLOWED_GLOBAL
+	int* allowed = ant_allowed_global + ant_idx * problem_size;
+#else
+	int* allowed = ant_allowed;
+#endif
+	uint* seed = rng_seeds + ant_idx;
+#ifdef BITMASK_WORDS
+	const int bitmask_size = BITMASK_WORDS;
+#else
+	const int bitmask_size = problem_size / BITMASK_SIZE + (problem_size % BITMASK_SIZE != 0 ? 1 : 0);
+#endif
+
+	int route_length = 0;
+
+	const int worker_pwr = ctz(~worker_idx);
+	const int max_pwr = ctz(worker_size) + 1;
+	local int current_node;
+	local double rng;
+	local int next_node;
+	if (worker_idx == 0) {
+		current_node = 0;
+		rng = 0.0;
+		next_node = -1;
+	}
+	for (int t = 0; t < TILE; t++) {
+		int node = worker_idx + t * worker_size;
+		if (node < problem_size) {
+			allowed[node] = ant_allowed_template[node];
+		}
+	}
+	for (int i = 1; i < problem_size; i++) {
+		barrier(CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE);
+		const global double* edge_values = probabilities + current_node * problem_size;
+		double tile_total = 0.0;
+		for (int t = 0; t < TILE; t++) {
+			int node = worker_idx + t * worker_size;
+			if (node < problem_size && allowed[node] == 0) {
+				tile_total += edge_values[node];
+			}
+		}
+		sample[worker_idx] = tile_total;
+
+		// Up-Sweep
+		double my_sample = sample[worker_idx]; // Added at the end
+		for (int i = 0; i < max_pwr; i++) {
+			barrier(CLK_LOCAL_MEM_FENCE);
+			if (worker_pwr > i) {
+				int merge_idx = 1UL << i;
+				sample[worker_idx] += sample[worker_idx - merge_idx];
+			}
+		}
+
+		if (worker_idx == worker_size - 1) {
+			sample[worker_idx] = 0;
+		}
+
+		// Down-Sweep
+		for (int i = max_pwr - 1; i >= 0; i--) {
+			barrier(CLK_LOCAL_MEM_FENCE);
+			if (worker_pwr > i) {
+				int merge_idx = 1UL << i;
+				double curr = sample[worker_idx];
+				sample[worker_idx] += sample[worker_idx - merge_idx];
+				sample[worker_idx - merge_idx] = curr;	
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		sample[worker_idx] += my_sample; // Make exclusive scan into inclusive one
+
+		if (worker_idx == worker_size - 1) {
+			rng = rng_range(seed, sample[worker_idx]);
+			next_node = -1;
+		}
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+		double tile_start = worker_idx == 0 ? 0.0 : sample[worker_idx - 1];
+		bool in_self_range = rng < sample[worker_idx] && rng >= tile_start;
+		if (in_self_range) {
+			double remaining = rng - tile_start;
+			int last_allowed = -1;
+			for (int t = 0; t < TILE; t++) {
+				int node = worker_idx + t * worker_size;
+				if (node >= problem_size || allowed[node] != 0) {
+					continue;
+				}
+				last_allowed = node;
+				remaining -= edge_values[node];
+				if (remaining < 0) {
+					break;
+				}
+			}
+			// Rounding may leave a tiny remainder, which belongs to the last allowed node of the tile
+			next_node = last_allowed;
+		}
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (worker_idx == 0) {
+			if (next_node < 0) {
+				current_node = -1;
+			}
+			else {
+				route_length += weights[current_node * problem_size + next_node];
+
+				current_node = next_node;
+				ant_route[i] = next_node;
+				allowed[next_node] = -1;
+			}
+		}
+
+		barrier(CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE);
+		if (current_node < 0) {
+			break;
+		}
+
+		const bitmask* dep_mask = dependencies + current_node * bitmask_size;
+		for (int t = 0; t < TILE; t++) {
+			int node = worker_idx + t * worker_size;
+			if (node < problem_size && has_bit(dep_mask, node)) {
+				// node depends on current_node => Update allowed entry
+				allowed[node] -= 1;
+			}
+		}
+	}
+
+	if (worker_idx == 0) {
+		ant_route_length[ant_idx] = (current_node == problem_size - 1) ? route_length : INT_MAX;
+	}
+}
+
+
+void kernel update_pheromone(
+global double* pheromone,
+global double* probabilities,
+global double* visibility,
+double alpha,
+double one_minus_roh,
+double min_pheromone,
+double max_pheromone,
+global const int* ant_routes,
+global const int* best_ant,
+double q,
+int problem_size
+) {
+#ifdef PROBLEM_SIZE
+	problem_size = PROBLEM_SIZE;
+#endif
+	const int best_ant_idx = best_ant[0];
+	const double best_ant_pheromone = q / best_ant[1];
+	int edge = get_global_id(0);
+	int from = edge / problem_size;
+	int to = edge % problem_size;
+	const int* best_ant_route = ant_routes + best_ant_idx * problem_size;
+
+	// Evaporate
+	pheromone[edge] *= one_minus_roh;
+
+	// Lay along best_ant
+	//? Could be "optimized" by looping one short, thereby removing the check for i+1 to be a valid index
+
+	//? Could also be made obsolete if a bitmask exists, containing each edge and whether it is part of the best_route (1) or not (0)
+
+	//? How about a list of each node containing the next node in the route
+	//? This would require reimagining the meaning of ant_route but nothing more
+	//? Because each node MUST occure in the route, there are as many entries as there are nodes
+	//? Currently, ant_route[index] is the node where ant was at step no #index
+	//? But ant_route[index] could also be interpreted as the next node that was chosen while standing at node "index"
+	//? No information would be lost (although retrieving the step-by-step best route would be slightly more complex)
+	//? But the following algorithm would be made possible
+	/*
+	? next_arr[problem_size]
+	? if next_arr[from] == to {
+	? 	pheromone[edge] += best_ant_pheromone
+	? }
+	*/
+	for (int i = 0; i < problem_size; i++) {
+		if (best_ant_route[i] != from) {
+			continue;
+		}
+
+		if (i + 1 >= problem_size) {
+			 continue;
+		}
+
+		if (best_ant_route[i + 1] != to) {
+			continue;
+		}
+
+		pheromone[edge] += best_ant_pheromone;
+	}
+
+	pheromone[edge] = clamp(pheromone[edge], min_pheromone, max_pheromone);
+
+	probabilities[edge] = powr(pheromone[edge], alpha) * visibility[edge];
+}
+
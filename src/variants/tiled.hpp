@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <random>
+#include <bitset>
+#include <type_traits>
+
+#include "clcolony.hpp"
+#include "../profiler.hpp"
+
+/*
+	localant for problems beyond the work-group and local memory limits of the device.
+	Each work-item owns `tile` nodes; the host picks work-group size and tile factor from the device limits.
+*/
+class TiledOptimizer: public CLColonyOptimizer {
+protected:
+	cl::Program program;
+	cl::KernelFunctor<
+		cl::Buffer, // probabilities
+		cl::Buffer, // weights
+		cl::Buffer, // dependencies
+		cl::Buffer, // ant_routes
+		cl::Buffer, // ant_routes_length
+		cl::LocalSpaceArg, // ant_sample
+		cl::LocalSpaceArg, // ant_allowed
+		cl::Buffer, // ant_allowed_global
+		cl::Buffer, // ant_allowed_template
+		cl_int,     // problem_size
+		cl::Buffer  // rng_seeds
+	> advanceAntsCL;
+
+	cl::KernelFunctor<
+		cl::Buffer, // pheromone
+		cl::Buffer, // probabilities
+		cl::Buffer, // visibility
+		cl_double, // alpha
+		cl_double, // one_minus_roh
+		cl_double, // min_pheromone
+		cl_double, // max_pheromone
+		cl::Buffer, // ant_routes
+		cl::Buffer, // best_ant
+		cl_double, // q
+		cl_int  // problem_size
+	> updatePheromoneCL;
+
+	cl::Buffer pheromone_d;
+	cl::Buffer visibility_d;
+	cl::Buffer weights_d;
+	cl::Buffer routes_d;
+	cl::Buffer routes_length_d;
+	cl::LocalSpaceArg ant_sample_d;
+	cl::LocalSpaceArg ant_allowed_d;
+	cl::Buffer ant_allowed_global_d;
+	cl::Buffer ant_allowed_template_d;
+	cl::Buffer rng_seeds_d;
+	cl::Buffer probabilities_d;
+	cl::Buffer dependencies_d;
+
+	size_t work_size = 0;
+	size_t tile = 1;
+	bool allowed_global = false;
+
+	size_t leftmost_one(size_t value) {
+		int i = 0;
+		for (; i < sizeof(size_t) * 8; i++) {
+			if (value >> i == 0) { return i; }
+		}
+		return i;
+	}
+
+	/*
+	Chooses the widest power-of-two work-group the device and the kernel allow, the tile factor covering all nodes with it,
+	and whether the allowed counters still fit into local memory next to the scan buffer.
+	*/
+	void chooseTiling() {
+		// Only a build without the fixed size reports the limits of the kernel itself
+		cl::Kernel unsized(loadProgramVariant(static_name, specializationArgs()), "wander_ant");
+		const size_t max_work_size = std::min<size_t>(
+			device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>(),
+			unsized.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		const size_t local_mem_size = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+		// Local memory of the kernel before its arguments are set: current_node, rng, next_node and what the compiler adds
+		const size_t reserved_local_mem = unsized.getWorkGroupInfo<CL_KERNEL_LOCAL_MEM_SIZE>(device);
+
+		work_size = 1UL << leftmost_one(problem.size() - 1);
+		while (work_size > max_work_size || work_size * sizeof(cl_double) + reserved_local_mem > local_mem_size) {
+			work_size /= 2;
+		}
+		if (work_size == 0) {
+			throw std::runtime_error("[OpenCL] tiled: Device has not enough local memory for a scan");
+		}
+		tile = problem.size() / work_size + (problem.size() % work_size != 0 ? 1 : 0);
+		allowed_global = work_size * sizeof(cl_double) + problem.size() * sizeof(cl_int) + reserved_local_mem > local_mem_size;
+	}
+
+	StageEvents advanceAnts(const StageEvents& wait_for) {
+		cl::NDRange global_size(work_size, ant_count);
+		cl::NDRange local_size(work_size, 1);
+		return { advanceAntsCL(
+			cl::EnqueueArgs(queue, wait_for, global_size, local_size),
+			probabilities_d,
+			weights_d,
+			dependencies_d,
+			routes_d,
+			routes_length_d,
+			ant_sample_d,
+			ant_allowed_d,
+			ant_allowed_global_d,
+			ant_allowed_template_d,
+			problem.size(),
+			rng_seeds_d			
+		) };
+	}
+
+	StageEvents updatePheromone(const StageEvents& wait_for, double q) {
+		cl::NDRange global_size(problem.size() * problem.size());
+		return { updatePheromoneCL(
+			cl::EnqueueArgs(queue, wait_for, global_size),
+			pheromone_d,
+			probabilities_d,
+			visibility_d,
+			params.alpha,
+			1 - params.rho,
+			params.min_pheromone,
+			params.max_pheromone,
+			routes_d,
+			best_ant_d,
+			q,
+			problem.size()
+		) };
+	}
+
+public:
+	static constexpr const char* static_name = "tiled";
+	static constexpr const char* static_params = "";
+
+	TiledOptimizer(Problem problem, AntParams params)
+	:	CLColonyOptimizer::CLColonyOptimizer(problem, params),
+		advanceAntsCL(cl::Kernel()),
+		updatePheromoneCL(cl::Kernel()),
+		pheromone(problem.size(), params.initial_pheromone) {}
+
+	Graph<double> pheromone;
+
+	/*
+	Samples stay in local memory, the probabilities row is read once for the tile totals
+	and the chosen tile once more. Allowed counters go through global memory
+	only if they do not fit into local memory
+	*/
+	RoundCost roundCost() const override {
+		RoundCost cost = CLColonyOptimizer::roundCost();
+		const double n = problem.size();
+		const double steps = ant_count * (n - 1);
+		cost.advance.bytes = steps * (n * sizeof(double) + n / 8 + (allowed_global ? n * 2 * sizeof(int) : 0) + tile * sizeof(double));
+		// Tile totals, the scan over the work-items, the walk of the chosen tile
+		cost.advance.flops = steps * (n + 2 * work_size + tile);
+		return cost;
+	}
+
+	void prepare() override {
+		setupCL(false);
+		chooseTiling();
+		std::string tiling_args = " -DTILE=" + std::to_string(tile) + (allowed_global ? " -DALLOWED_GLOBAL" : "");
+		program = loadProgramVariant(static_name, specializationArgs(work_size) + tiling_args);
+
+		pheromone_d = createAndFillBuffer("pheromone", problem.sizeSqr(), false, pheromone);
+		weights_d = wrapHostBuffer("weights", problem.weights);
+		routes_d = createAndFillBuffer<int>("routes", ant_count * problem.size(), false, 0);
+		routes_length_d = createAndFillBuffer("routes_length", ant_count, false, std::numeric_limits<cl_int>::max());
+		probabilities_d = createAndFillBuffer<double>("probabilities", problem.sizeSqr(), false, 0.0);
+		ant_sample_d = createLocalBuffer<double>(work_size);
+		ant_allowed_d = createLocalBuffer<int>(allowed_global ? 1 : problem.size());
+		ant_allowed_global_d = createBuffer<int>("ant_allowed_global", allowed_global ? ant_count * problem.size() : 1, false);
+
+		dependencies_d = createDependencyBuffer(false);
+
+		visibility_d = createVisibilityBuffer();
+
+		std::vector<int> allowed_data = getAllowedList();
+		ant_allowed_template_d = createAndFillBuffer("ant_allowed_template", allowed_data.size(), true, allowed_data);
+
+		std::vector<uint> rngs = getRngs();
+		rng_seeds_d = createAndFillBuffer("rng_seeds", rngs.size(), false, rngs);
+
+		setupBestAnt();
+		queue.finish();
+
+		advanceAntsCL = decltype(advanceAntsCL)(cl::Kernel(program, "wander_ant"));
+		updatePheromoneCL = decltype(updatePheromoneCL)(cl::Kernel(program, "update_pheromone"));
+
+		updatePheromone({}, 0);
+		queue.finish();
+	}
+
+	void optimize(unsigned int rounds) override {
+		runPipeline(rounds, routes_length_d,
+			[this](const StageEvents& wait_for) { return advanceAnts(wait_for); },
+			[this](const StageEvents& wait_for) { return updatePheromone(wait_for, params.q); });
+	}
+};
+
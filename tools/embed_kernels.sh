@@ -0,0 +1,55 @@
+#!/bin/bash
+
+# Generates a header embedding the given OpenCL kernels into the executable.
+# Usage:
+# >> tools/embed_kernels.sh <output.hpp> [--spirv <directory>] <kernel.cl>...
+#
+# If --spirv is given, <directory>/<name>.spv is embedded alongside the source
+# of <name>.cl whenever it exists.
+
+set -e
+
+output=$1
+shift
+
+spirv_dir=""
+if [ "$1" == "--spirv" ]; then
+	spirv_dir=$2
+	shift 2
+fi
+
+tmp="$output.tmp"
+
+echo "// Generated by tools/embed_kernels.sh, do not edit" > "$tmp"
+echo "" >> "$tmp"
+
+for kernel in "$@"
+do
+	name=$(basename "$kernel" .cl)
+	ident=$(echo "$name" | tr -c 'A-Za-z0-9_\n' '_')
+	spirv="$spirv_dir/$name.spv"
+	if [ -n "$spirv_dir" ] && [ -f "$spirv" ]; then
+		echo "static constexpr unsigned char embedded_spirv_$ident[] = {" >> "$tmp"
+		od -An -v -tx1 "$spirv" | sed -e 's/ *\([0-9a-f][0-9a-f]\)/0x\1, /g' -e 's/^/\t/' >> "$tmp"
+		echo "};" >> "$tmp"
+		echo "" >> "$tmp"
+	fi
+done
+
+echo "static constexpr EmbeddedKernel embedded_kernels[] = {" >> "$tmp"
+for kernel in "$@"
+do
+	name=$(basename "$kernel" .cl)
+	ident=$(echo "$name" | tr -c 'A-Za-z0-9_\n' '_')
+	spirv="$spirv_dir/$name.spv"
+	echo "	{ \"$name\", R\"__kernel__(" >> "$tmp"
+	cat "$kernel" >> "$tmp"
+	if [ -n "$spirv_dir" ] && [ -f "$spirv" ]; then
+		echo ")__kernel__\", embedded_spirv_$ident, sizeof(embedded_spirv_$ident) }," >> "$tmp"
+	else
+		echo ")__kernel__\", nullptr, 0 }," >> "$tmp"
+	fi
+done
+echo "};" >> "$tmp"
+
+mv "$tmp" "$output"